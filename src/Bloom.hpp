@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ds
+{
+    //what keyHash returns for a trivially copyable key whose raw bytes do not decide equality (padding). converts
+    //to the hash so generic code still compiles for such keys, the features that rely on equal keys hashing
+    //equally check HasKeyHash and refuse the type until it gets an overload over the fields that count
+    struct ByteHash
+    {
+        uint64_t value;
+
+        operator uint64_t() const
+        {
+            return value;
+        }
+    };
+
+    template <class T>
+    using KeyHashResult = std::conditional_t<std::is_trivially_copyable<T>::value && !std::is_floating_point<T>::value &&
+        !std::has_unique_object_representations<T>::value, ByteHash, uint64_t>;
+
+    //64-bit hash of a key: the raw bytes for trivially copyable keys, std::hash for floating point keys (0.0 and
+    //-0.0 compare equal but differ in their bytes) and for the rest. equal keys must hash equally or the Bloom
+    //filter reports present keys as absent, key types whose fields operator == ignores need their own overload
+    template <class T>
+    inline KeyHashResult<T> keyHash(const T& key)
+    {
+        uint64_t h = 14695981039346656037ull;
+
+        if constexpr (std::is_trivially_copyable<T>::value && !std::is_floating_point<T>::value)
+        {
+            const unsigned char* p = (const unsigned char*)&key;
+
+            for (size_t i = 0; i < sizeof(T); i++)
+            {
+                h ^= p[i];
+                h *= 1099511628211ull;
+            }
+        }
+        else
+        {
+            h ^= (uint64_t)std::hash<T>()(key);
+        }
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return KeyHashResult<T>{ h };
+    }
+
+    //true if keyHash of T hashes what decides equality, either through an overload or because the raw bytes do
+    template <class T>
+    struct HasKeyHash : std::is_same<decltype(keyHash(std::declval<const T&>())), uint64_t>
+    {
+    };
+
+    struct BloomStats
+    {
+        uint64_t queries;                       //lookups that consulted the filter
+        uint64_t filtered;                      //rejected by the filter without touching the tree
+        uint64_t falsePositives;                //passed the filter but were absent
+        size_t bits;
+        double falsePositiveRate;               //falsePositives / (filtered + falsePositives)
+    };
+
+    //Bloom filter whose probes for one key all land in the same 64-byte block, so a lookup touches a single
+    //cache line. the high half of the hash picks the block, a remix of it gives 7 bit positions of 9 bits each
+    class BlockedBloomFilter
+    {
+    public:
+        static const size_t BLOCK_WORDS = 8;
+        static const size_t PROBES = 7;
+
+        explicit BlockedBloomFilter(std::pmr::memory_resource* r = std::pmr::get_default_resource()) : storage(r)
+        {
+        }
+
+        //blocks holding expected keys at bitsPerKey, at least one
+        static size_t blocksFor(size_t expected, size_t bitsPerKey = 10)
+        {
+            return (std::max)((expected * bitsPerKey + 511) / 512, (size_t)1);
+        }
+
+        //sizes the filter for expected keys at bitsPerKey and empties it
+        void reset(size_t expected, size_t bitsPerKey = 10)
+        {
+            blocks = blocksFor(expected, bitsPerKey);
+
+            storage.assign(blocks * BLOCK_WORDS + BLOCK_WORDS - 1, 0);
+
+            uintptr_t at = (uintptr_t)storage.data();
+            offset = ((64 - at % 64) % 64) / sizeof(uint64_t);  //first block on a cache line boundary
+
+            sized = expected;
+        }
+
+        void add(uint64_t h)
+        {
+            add(storage.data() + offset, blocks, h);
+        }
+
+        bool mayContain(uint64_t h) const
+        {
+            return mayContain(storage.data() + offset, blocks, h);
+        }
+
+        //the same filter over blocks * BLOCK_WORDS words kept elsewhere, such as the filter of an LSM run file
+        static void add(uint64_t* words, size_t blocks, uint64_t h)
+        {
+            uint64_t p = probes(h);
+            uint64_t* block = words + ((h >> 32) * blocks >> 32) * BLOCK_WORDS;
+
+            for (size_t i = 0; i < PROBES; i++)
+            {
+                uint64_t bit = (p >> (i * 9)) & 511;
+                block[bit >> 6] |= 1ull << (bit & 63);
+            }
+        }
+
+        static bool mayContain(const uint64_t* words, size_t blocks, uint64_t h)
+        {
+            uint64_t p = probes(h);
+            const uint64_t* block = words + ((h >> 32) * blocks >> 32) * BLOCK_WORDS;
+
+            for (size_t i = 0; i < PROBES; i++)
+            {
+                uint64_t bit = (p >> (i * 9)) & 511;
+                if ((block[bit >> 6] & (1ull << (bit & 63))) == 0) return false;
+            }
+
+            return true;
+        }
+
+        //keys the filter was sized for
+        size_t capacity() const
+        {
+            return sized;
+        }
+
+        size_t bits() const
+        {
+            return blocks * 512;
+        }
+
+    private:
+        static uint64_t probes(uint64_t h)
+        {
+            h *= 0x9e3779b97f4a7c15ull;
+            return h ^ (h >> 31);
+        }
+
+    private:
+        std::pmr::vector<uint64_t> storage;
+        size_t offset{ 0 };
+        size_t blocks{ 0 };
+        size_t sized{ 0 };
+    };
+}
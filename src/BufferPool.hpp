@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "File.hpp"
+
+namespace ds
+{
+    const size_t POOL_PAGE_SIZE = 4096;
+
+    class BufferPool;
+
+    //pins a page in the pool for as long as it lives, the frame cannot be evicted meanwhile
+    class PageHandle
+    {
+    public:
+        PageHandle() = default;
+        PageHandle(const PageHandle&) = delete;
+        PageHandle& operator=(const PageHandle&) = delete;
+
+        PageHandle(PageHandle&& h) noexcept
+        {
+            *this = std::move(h);
+        }
+
+        PageHandle& operator=(PageHandle&& h) noexcept;
+
+        ~PageHandle()
+        {
+            release();
+        }
+
+        void release();
+
+        bool valid() const { return pool != nullptr; }
+        uint64_t page() const { return id; }
+        char* data() const { return bytes; }
+
+        //the page is written back before its frame is reused
+        void markDirty();
+
+    private:
+        friend class BufferPool;
+
+        PageHandle(BufferPool* p, size_t f, uint64_t i, char* b) : pool(p), frame(f), id(i), bytes(b) {}
+
+        BufferPool* pool{ nullptr };
+        size_t frame{ 0 };
+        uint64_t id{ 0 };
+        char* bytes{ nullptr };
+    };
+
+    //fixed set of page frames over a BlockFile, evicted with the CLOCK algorithm (an LRU approximation:
+    //every access sets a reference bit, the hand clears it and takes the first unpinned frame without one)
+    class BufferPool
+    {
+    public:
+        BufferPool() = default;
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        ~BufferPool()
+        {
+            close();
+        }
+
+        bool open(const char* path, size_t frames)
+        {
+            close();
+
+            if (!file.open(path)) return false;
+
+            frames = (std::max)(frames, (size_t)16);
+            memory.assign(frames * POOL_PAGE_SIZE, 0);
+            meta.assign(frames, Frame());
+            table.clear();
+            table.reserve(frames);
+            hand = 0;
+            hits = misses = 0;
+            return true;
+        }
+
+        //writes dirty pages back and closes the file, every handle must be released
+        bool close()
+        {
+            if (!file.isOpen()) return true;
+
+            bool flushed = flush();
+            file.close();
+            memory.clear();
+            meta.clear();
+            table.clear();
+            return flushed;
+        }
+
+        //pins page, reading it from the file if it is not resident. an invalid handle means a read error
+        //or that every frame is pinned
+        PageHandle fetch(uint64_t page)
+        {
+            auto it = table.find(page);
+
+            if (it != table.end())
+            {
+                hits++;
+                return pin(it->second);
+            }
+
+            misses++;
+
+            size_t f;
+            if (!victim(f)) return PageHandle();
+
+            if (!file.read(page * POOL_PAGE_SIZE, frame(f), POOL_PAGE_SIZE))
+            {
+                meta[f].used = false;
+                return PageHandle();
+            }
+
+            install(f, page);
+            return pin(f);
+        }
+
+        //pins a zeroed frame for a page that has no content on disk yet
+        PageHandle create(uint64_t page)
+        {
+            auto it = table.find(page);
+            size_t f;
+
+            if (it != table.end()) f = it->second;
+            else if (victim(f)) install(f, page);
+            else return PageHandle();
+
+            memset(frame(f), 0, POOL_PAGE_SIZE);
+            meta[f].dirty = true;
+            return pin(f);
+        }
+
+        //reads the pages that are not resident yet without pinning them, runs of consecutive page numbers
+        //are read with a single call. at most a quarter of the frames is used so a scan cannot flush the pool
+        void prefetch(std::vector<uint64_t> pages)
+        {
+            std::sort(pages.begin(), pages.end());
+            pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+            pages.erase(std::remove_if(pages.begin(), pages.end(), [this](uint64_t p) { return table.count(p) != 0; }), pages.end());
+
+            if (pages.size() > meta.size() / 4) pages.resize(meta.size() / 4);
+
+            std::vector<char> run;
+
+            for (size_t i = 0; i < pages.size();)
+            {
+                size_t j = i + 1;
+                while (j < pages.size() && pages[j] == pages[j - 1] + 1) j++;
+
+                run.resize((j - i) * POOL_PAGE_SIZE);
+                if (!file.read(pages[i] * POOL_PAGE_SIZE, run.data(), run.size())) return;
+
+                for (size_t k = i; k < j; k++)
+                {
+                    size_t f;
+                    if (!victim(f)) return;
+
+                    memcpy(frame(f), run.data() + (k - i) * POOL_PAGE_SIZE, POOL_PAGE_SIZE);
+                    install(f, pages[k]);
+                }
+
+                i = j;
+            }
+        }
+
+        //writes every dirty page back and syncs the file
+        bool flush()
+        {
+            bool written = true;
+
+            for (size_t f = 0; f < meta.size(); f++)
+                if (meta[f].used && meta[f].dirty)
+                {
+                    if (file.write(meta[f].page * POOL_PAGE_SIZE, frame(f), POOL_PAGE_SIZE)) meta[f].dirty = false;
+                    else written = false;
+                }
+
+            return written && file.sync();
+        }
+
+        uint64_t fileSize()
+        {
+            return file.size();
+        }
+
+        size_t frameCount() const
+        {
+            return meta.size();
+        }
+
+        uint64_t hitCount() const { return hits; }
+        uint64_t missCount() const { return misses; }
+
+    private:
+        friend class PageHandle;
+
+        struct Frame
+        {
+            uint64_t page{ 0 };
+            uint32_t pins{ 0 };
+            bool used{ false };
+            bool dirty{ false };
+            bool referenced{ false };
+        };
+
+        char* frame(size_t f)
+        {
+            return memory.data() + f * POOL_PAGE_SIZE;
+        }
+
+        PageHandle pin(size_t f)
+        {
+            meta[f].pins++;
+            meta[f].referenced = true;
+            return PageHandle(this, f, meta[f].page, frame(f));
+        }
+
+        void unpin(size_t f)
+        {
+            meta[f].pins--;
+        }
+
+        void install(size_t f, uint64_t page)
+        {
+            meta[f].page = page;
+            meta[f].used = true;
+            meta[f].dirty = false;
+            meta[f].referenced = true;
+            table[page] = f;
+        }
+
+        //frees a frame, writing its page back if dirty. two sweeps of the hand clear every reference bit,
+        //so failing after them means every frame is pinned
+        bool victim(size_t& f)
+        {
+            for (size_t step = 0; step < 2 * meta.size(); step++)
+            {
+                size_t i = hand;
+                hand = (hand + 1) % meta.size();
+
+                if (!meta[i].used)
+                {
+                    f = i;
+                    return true;
+                }
+
+                if (meta[i].pins > 0) continue;
+
+                if (meta[i].referenced)
+                {
+                    meta[i].referenced = false;
+                    continue;
+                }
+
+                if (meta[i].dirty && !file.write(meta[i].page * POOL_PAGE_SIZE, frame(i), POOL_PAGE_SIZE)) return false;
+
+                table.erase(meta[i].page);
+                meta[i].used = false;
+                meta[i].dirty = false;
+                f = i;
+                return true;
+            }
+
+            return false;
+        }
+
+    private:
+        BlockFile file;
+        std::vector<char> memory;               //frames, POOL_PAGE_SIZE bytes each
+        std::vector<Frame> meta;
+        std::unordered_map<uint64_t, size_t> table;     //resident page -> frame
+        size_t hand{ 0 };
+        uint64_t hits{ 0 };
+        uint64_t misses{ 0 };
+    };
+
+    inline PageHandle& PageHandle::operator=(PageHandle&& h) noexcept
+    {
+        if (this != &h)
+        {
+            release();
+            pool = h.pool;
+            frame = h.frame;
+            id = h.id;
+            bytes = h.bytes;
+            h.pool = nullptr;
+            h.bytes = nullptr;
+        }
+
+        return *this;
+    }
+
+    inline void PageHandle::release()
+    {
+        if (pool != nullptr) pool->unpin(frame);
+        pool = nullptr;
+        bytes = nullptr;
+    }
+
+    inline void PageHandle::markDirty()
+    {
+        pool->meta[frame].dirty = true;
+    }
+}
@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DS_PACKED_SSE2
+#endif
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    const size_t PACKED_BLOCK_KEYS = 128;
+    const uint32_t PACKED_LANES = 4;
+
+    //up to PACKED_BLOCK_KEYS sorted distinct keys that all lie within 2^32 of the first one. every key after the
+    //first is stored as its gap to the previous key minus one, bit-packed at the width of the largest gap,
+    //so a run of consecutive keys takes no bits at all. gap g goes to lane g % 4, and each lane is its own
+    //bit stream with its words interleaved with the other lanes', so the gaps of four consecutive keys sit at
+    //the same bit offset of four adjacent words and one SSE2 shift unpacks all of them
+    struct PackedBlock
+    {
+        int64_t base;                           //first key
+        uint32_t count;
+        uint32_t width;                         //bits per gap, 0 to 32
+        std::vector<uint32_t> words;            //word w of lane l at w * PACKED_LANES + l, low bits first
+
+        //reads the gaps in order, refilling a 64-bit buffer per lane one word at a time instead of loading a
+        //pair of words for every gap
+        struct GapReader
+        {
+            const uint32_t* words;
+            uint64_t buffer[PACKED_LANES]{};
+            uint32_t bits[PACKED_LANES]{};      //unread bits in buffer
+            uint32_t loaded[PACKED_LANES]{};    //words of the lane read so far
+            uint32_t lane{ 0 };
+            uint32_t width;
+
+            explicit GapReader(const PackedBlock& b) : words(b.words.data()), width(b.width) {}
+
+            //offset of the next key from the previous one
+            uint32_t next()
+            {
+                if (width == 0) return 1;
+
+                uint32_t l = lane;
+                lane = (lane + 1) % PACKED_LANES;
+
+                if (bits[l] < width)
+                {
+                    buffer[l] |= (uint64_t)words[loaded[l]++ * PACKED_LANES + l] << bits[l];
+                    bits[l] += 32;
+                }
+
+                uint32_t gap = (uint32_t)(buffer[l] & ((1ull << width) - 1));
+                buffer[l] >>= width;
+                bits[l] -= width;
+                return gap + 1;
+            }
+        };
+
+        //fills the block from sorted distinct keys [begin, end), which must satisfy the limits above
+        void encode(const int64_t* begin, const int64_t* end)
+        {
+            base = *begin;
+            count = (uint32_t)(end - begin);
+
+            uint32_t largest = 0;
+            for (const int64_t* k = begin + 1; k < end; k++)
+                largest = (std::max)(largest, (uint32_t)((uint64_t)*k - (uint64_t)k[-1] - 1));
+
+            width = 0;
+            while (width < 32 && (largest >> width) != 0) width++;
+
+            size_t rows = (count - 1 + PACKED_LANES - 1) / PACKED_LANES;
+            words.assign((rows * width + 31) / 32 * PACKED_LANES, 0);
+            if (width == 0) return;
+
+            for (uint32_t g = 0; g + 1 < count; g++)
+            {
+                uint64_t gap = (uint64_t)begin[g + 1] - (uint64_t)begin[g] - 1;
+                size_t bit = (size_t)(g / PACKED_LANES) * width;
+                uint32_t* at = &words[bit / 32 * PACKED_LANES + g % PACKED_LANES];
+
+                at[0] |= (uint32_t)(gap << (bit % 32));
+                if (bit % 32 + width > 32) at[PACKED_LANES] |= (uint32_t)(gap >> (32 - bit % 32));
+            }
+        }
+
+        //writes the offset from base of every key, four at a time where SSE2 is available
+        void decode(uint32_t* offsets) const
+        {
+#ifdef DS_PACKED_SSE2
+            offsets[0] = 0;
+            __m128i carry = _mm_setzero_si128();
+
+            for (uint32_t i = 1; i < count; i += PACKED_LANES)
+            {
+                __m128i x = _mm_add_epi32(prefixSum(gaps((i - 1) / PACKED_LANES)), carry);
+                carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+
+                if (count - i >= PACKED_LANES)
+                {
+                    _mm_storeu_si128((__m128i*)(offsets + i), x);
+                    continue;
+                }
+
+                uint32_t out[PACKED_LANES];
+                _mm_storeu_si128((__m128i*)out, x);
+                for (uint32_t j = 0; i + j < count; j++) offsets[i + j] = out[j];
+            }
+#else
+            decodeScalar(offsets);
+#endif
+        }
+
+        //the portable decode, also what the SSE2 one is checked against
+        void decodeScalar(uint32_t* offsets) const
+        {
+            GapReader gaps(*this);
+            uint32_t at = 0;
+            offsets[0] = 0;
+
+            for (uint32_t i = 1; i < count; i++)
+                offsets[i] = (at += gaps.next());
+        }
+
+        bool contains(int64_t key) const
+        {
+            if (key < base || (uint64_t)key - (uint64_t)base > UINT32_MAX) return false;
+
+            uint32_t target = (uint32_t)((uint64_t)key - (uint64_t)base);
+            if (target == 0) return true;
+
+#ifdef DS_PACKED_SSE2
+            __m128i carry = _mm_setzero_si128();
+            __m128i wanted = _mm_set1_epi32((int)target);
+
+            for (uint32_t i = 1; i < count; i += PACKED_LANES)
+            {
+                __m128i x = _mm_add_epi32(prefixSum(gaps((i - 1) / PACKED_LANES)), carry);
+                carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+
+                int hits = _mm_movemask_epi8(_mm_cmpeq_epi32(x, wanted));
+                if (count - i < PACKED_LANES) hits &= (1 << (4 * (count - i))) - 1;     //lanes past the last key
+
+                if (hits != 0) return true;
+                if ((uint32_t)_mm_cvtsi128_si32(carry) > target) return false;
+            }
+
+            return false;
+#else
+            GapReader gaps(*this);
+            uint32_t at = 0;
+
+            for (uint32_t i = 1; i < count && at < target; i++)
+                if ((at += gaps.next()) == target) return true;
+
+            return false;
+#endif
+        }
+
+        void append(std::vector<int64_t>& out) const
+        {
+            uint32_t offsets[PACKED_BLOCK_KEYS];
+            decode(offsets);
+
+            for (uint32_t i = 0; i < count; i++)
+                out.push_back((int64_t)((uint64_t)base + offsets[i]));
+        }
+
+#ifdef DS_PACKED_SSE2
+    private:
+        //steps of keys 4 * row + 1 to 4 * row + 4. a row past the last gap reads zero bits, steps of 1
+        __m128i gaps(uint32_t row) const
+        {
+            if (width == 0) return _mm_set1_epi32(1);
+
+            size_t bit = (size_t)row * width;
+            const __m128i* at = (const __m128i*)(words.data() + bit / 32 * PACKED_LANES);
+
+            __m128i x = _mm_srl_epi32(_mm_loadu_si128(at), _mm_cvtsi32_si128((int)(bit % 32)));
+            if (bit % 32 + width > 32) x = _mm_or_si128(x, _mm_sll_epi32(_mm_loadu_si128(at + 1), _mm_cvtsi32_si128((int)(32 - bit % 32))));
+
+            x = _mm_and_si128(x, _mm_set1_epi32((int)(uint32_t)((1ull << width) - 1)));
+            return _mm_add_epi32(x, _mm_set1_epi32(1));
+        }
+
+        static __m128i prefixSum(__m128i x)
+        {
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+            return _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        }
+#endif
+    };
+
+    //entry of the index tree, ordered by the first key of its block
+    struct PackedRef
+    {
+        int64_t first;
+        PackedBlock* block;
+
+        bool operator < (const PackedRef& r) const { return first < r.first; }
+        bool operator > (const PackedRef& r) const { return r.first < first; }
+        bool operator == (const PackedRef& r) const { return first == r.first; }
+    };
+
+    //the block pointer is left out, so a lookup by first key alone hashes like the stored entry
+    inline uint64_t keyHash(const PackedRef& r)
+    {
+        return keyHash(r.first);
+    }
+
+    //set of int64_t keys whose leaves are PackedBlocks: a TwoThreeTree indexes the blocks by their first key and
+    //a key lives in the block with the largest first key not above it. for dense key spaces this takes a few
+    //bytes per key instead of a node per one or two keys
+    class CompressedTree
+    {
+    public:
+        CompressedTree() = default;
+        CompressedTree(const CompressedTree&) = delete;
+        CompressedTree& operator=(const CompressedTree&) = delete;
+
+        ~CompressedTree()
+        {
+            clear();
+        }
+
+        bool insert(int64_t key)
+        {
+            PackedRef* ref = floorRef(key);
+            if (ref == NULL) ref = firstRef();  //key is below every block, it becomes the first key of the first one
+
+            if (ref == NULL)
+            {
+                store(PackedRef{ key, NULL }, std::vector<int64_t>(1, key));
+                keyCount++;
+                return true;
+            }
+
+            if (ref->block->contains(key)) return false;
+
+            PackedRef old = *ref;
+            std::vector<int64_t> keys;
+            old.block->append(keys);
+            keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+
+            store(old, keys);
+            keyCount++;
+            return true;
+        }
+
+        bool erase(int64_t key)
+        {
+            PackedRef* ref = floorRef(key);
+            if (ref == NULL || !ref->block->contains(key)) return false;
+
+            PackedRef old = *ref;
+            std::vector<int64_t> keys;
+            old.block->append(keys);
+            keys.erase(std::lower_bound(keys.begin(), keys.end(), key));
+
+            store(old, keys);
+            keyCount--;
+            return true;
+        }
+
+        bool contains(int64_t key)
+        {
+            PackedRef* ref = floorRef(key);
+            return ref != NULL && ref->block->contains(key);
+        }
+
+        //calls fn(key) for every key in [lo, hi] in ascending order
+        template <class Fn>
+        void forRange(int64_t lo, int64_t hi, Fn fn)
+        {
+            if (hi < lo) return;
+
+            PackedRef* start = floorRef(lo);
+            PackedRef from{ (start != NULL) ? start->first : lo, NULL };
+            uint32_t offsets[PACKED_BLOCK_KEYS];
+
+            tree.forRange(from, PackedRef{ hi, NULL }, [&](const PackedRef& r)
+                {
+                    r.block->decode(offsets);
+
+                    for (uint32_t i = 0; i < r.block->count; i++)
+                    {
+                        int64_t k = (int64_t)((uint64_t)r.block->base + offsets[i]);
+                        if (hi < k) return;
+                        if (!(k < lo)) fn(k);
+                    }
+                });
+        }
+
+        //replaces the contents with the keys in [begin, end), in any order, packed into full blocks
+        template <class Iter>
+        void build(Iter begin, Iter end)
+        {
+            clear();
+
+            std::vector<int64_t> keys(begin, end);
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            std::vector<PackedRef> refs;
+            pack(keys, PACKED_BLOCK_KEYS, refs);
+            tree.buildParallel(refs.begin(), refs.end());
+            keyCount = keys.size();
+        }
+
+        //refills every block to capacity, erases leave blocks partly empty
+        void repack()
+        {
+            std::vector<int64_t> keys;
+            keys.reserve(keyCount);
+            tree.forEach([&keys](const PackedRef& r) { r.block->append(keys); });
+
+            build(keys.begin(), keys.end());
+        }
+
+        void clear()
+        {
+            tree.forEach([](const PackedRef& r) { delete r.block; });
+            tree.clear();
+            keyCount = 0;
+            blocks = 0;
+        }
+
+        size_t size() const
+        {
+            return keyCount;
+        }
+
+        size_t blockCount() const
+        {
+            return blocks;
+        }
+
+        //approximate heap footprint of the blocks and the index nodes above them
+        size_t memoryBytes()
+        {
+            size_t bytes = 0;
+            tree.forEach([&bytes](const PackedRef& r) { bytes += sizeof(PackedBlock) + r.block->words.capacity() * sizeof(uint32_t); });
+
+            return bytes + blocks * sizeof(TwoThreeNode<PackedRef>);
+        }
+
+        TwoThreeTree<PackedRef>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        //ref of the block with the largest first key not above key, NULL if there is none
+        PackedRef* floorRef(int64_t key)
+        {
+            PackedRef* best = NULL;
+
+            for (TwoThreeNode<PackedRef>* r = tree.root; r != NULL;)
+            {
+                if (r->n == 2 && !(key < r->k2.first))
+                {
+                    best = &r->k2;
+                    r = r->right;
+                }
+                else if (!(key < r->k1.first))
+                {
+                    best = &r->k1;
+                    r = r->middle;
+                }
+                else r = r->left;
+            }
+
+            return best;
+        }
+
+        PackedRef* firstRef()
+        {
+            TwoThreeNode<PackedRef>* r = tree.root;
+            if (r == NULL) return NULL;
+
+            while (r->left != NULL) r = r->left;
+            return &r->k1;
+        }
+
+        //puts keys where the block of old was. the block is rewritten in place while it stays a single block
+        //with the same first key, otherwise old leaves the index and one or more new blocks enter it
+        void store(PackedRef old, const std::vector<int64_t>& keys)
+        {
+            if (old.block != NULL && !keys.empty() && keys.size() <= PACKED_BLOCK_KEYS && keys.front() == old.first
+                && (uint64_t)keys.back() - (uint64_t)keys.front() <= UINT32_MAX)
+            {
+                old.block->encode(keys.data(), keys.data() + keys.size());
+                return;
+            }
+
+            if (old.block != NULL)
+            {
+                tree.deleteNode(old);
+                delete old.block;
+                blocks--;
+            }
+
+            //an overflowing block splits in two halves so both have room to grow
+            std::vector<PackedRef> refs;
+            pack(keys, (keys.size() > PACKED_BLOCK_KEYS) ? (keys.size() + 1) / 2 : PACKED_BLOCK_KEYS, refs);
+
+            for (const PackedRef& r : refs) tree.insert(r);
+        }
+
+        //cuts sorted distinct keys into blocks of at most limit keys, each spanning less than 2^32
+        void pack(const std::vector<int64_t>& keys, size_t limit, std::vector<PackedRef>& refs)
+        {
+            for (size_t i = 0; i < keys.size();)
+            {
+                size_t j = i + 1;
+                while (j < keys.size() && j - i < limit && (uint64_t)keys[j] - (uint64_t)keys[i] <= UINT32_MAX) j++;
+
+                PackedBlock* b = new PackedBlock();
+                b->encode(keys.data() + i, keys.data() + j);
+                refs.push_back(PackedRef{ keys[i], b });
+                blocks++;
+
+                i = j;
+            }
+        }
+
+    private:
+        TwoThreeTree<PackedRef> tree;
+        size_t keyCount{ 0 };
+        size_t blocks{ 0 };
+    };
+}
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace ds
+{
+    //read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+            close();
+        }
+
+        bool open(const char* path)
+        {
+            close();
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) return false;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+            {
+                close();
+                return false;
+            }
+
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL)
+            {
+                close();
+                return false;
+            }
+
+            base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            length = (size_t)size.QuadPart;
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) return false;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);                        //the mapping keeps the file alive
+
+            base = (p == MAP_FAILED) ? nullptr : (const char*)p;
+            length = (size_t)st.st_size;
+#endif
+            if (base == nullptr)
+            {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (base != nullptr) UnmapViewOfFile(base);
+            if (mapping != NULL) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (base != nullptr) munmap((void*)base, length);
+#endif
+            base = nullptr;
+            length = 0;
+        }
+
+        const char* data() const { return base; }
+        size_t size() const { return length; }
+        bool isOpen() const { return base != nullptr; }
+
+    private:
+#ifdef _WIN32
+        HANDLE file{ INVALID_HANDLE_VALUE };
+        HANDLE mapping{ NULL };
+#endif
+        const char* base{ nullptr };
+        size_t length{ 0 };
+    };
+
+    //write-only file that is appended to, sync() makes what was written durable
+    class AppendFile
+    {
+    public:
+        AppendFile() = default;
+        AppendFile(const AppendFile&) = delete;
+        AppendFile& operator=(const AppendFile&) = delete;
+
+        ~AppendFile()
+        {
+            close();
+        }
+
+        //opens path for appending, creating it if needed. everything past the first keep bytes is dropped
+        bool open(const char* path, uint64_t keep)
+        {
+            close();
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) return false;
+
+            LARGE_INTEGER offset;
+            offset.QuadPart = (LONGLONG)keep;
+
+            if (!SetFilePointerEx(file, offset, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+            {
+                close();
+                return false;
+            }
+#else
+            fd = ::open(path, O_WRONLY | O_CREAT, 0644);
+            if (fd < 0) return false;
+
+            if (ftruncate(fd, (off_t)keep) != 0 || lseek(fd, 0, SEEK_END) < 0)
+            {
+                close();
+                return false;
+            }
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+        }
+
+        bool write(const void* data, size_t size)
+        {
+            const char* p = (const char*)data;
+
+            while (size > 0)
+            {
+#ifdef _WIN32
+                DWORD done = 0;
+                DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD)size;
+                if (!WriteFile(file, p, chunk, &done, NULL)) return false;
+#else
+                ssize_t done = ::write(fd, p, size);
+                if (done < 0 && errno == EINTR) continue;
+                if (done <= 0) return false;
+#endif
+                p += done;
+                size -= (size_t)done;
+            }
+
+            return true;
+        }
+
+        bool sync()
+        {
+#ifdef _WIN32
+            return FlushFileBuffers(file) != 0;
+#else
+            return fsync(fd) == 0;
+#endif
+        }
+
+        bool isOpen() const
+        {
+#ifdef _WIN32
+            return file != INVALID_HANDLE_VALUE;
+#else
+            return fd >= 0;
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE file{ INVALID_HANDLE_VALUE };
+#else
+        int fd{ -1 };
+#endif
+    };
+
+    //read-write file accessed at explicit offsets
+    class BlockFile
+    {
+    public:
+        BlockFile() = default;
+        BlockFile(const BlockFile&) = delete;
+        BlockFile& operator=(const BlockFile&) = delete;
+
+        ~BlockFile()
+        {
+            close();
+        }
+
+        //opens path, creating it if needed
+        bool open(const char* path)
+        {
+            close();
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            return file != INVALID_HANDLE_VALUE;
+#else
+            fd = ::open(path, O_RDWR | O_CREAT, 0644);
+            return fd >= 0;
+#endif
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+#endif
+        }
+
+        //reads exactly size bytes at offset, fails on a short read
+        bool read(uint64_t offset, void* data, size_t size)
+        {
+            char* p = (char*)data;
+
+            while (size > 0)
+            {
+#ifdef _WIN32
+                OVERLAPPED at = {};
+                at.Offset = (DWORD)offset;
+                at.OffsetHigh = (DWORD)(offset >> 32);
+
+                DWORD done = 0;
+                DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD)size;
+                if (!ReadFile(file, p, chunk, &done, &at) || done == 0) return false;
+#else
+                ssize_t done = pread(fd, p, size, (off_t)offset);
+                if (done < 0 && errno == EINTR) continue;
+                if (done <= 0) return false;
+#endif
+                p += done;
+                offset += (uint64_t)done;
+                size -= (size_t)done;
+            }
+
+            return true;
+        }
+
+        bool write(uint64_t offset, const void* data, size_t size)
+        {
+            const char* p = (const char*)data;
+
+            while (size > 0)
+            {
+#ifdef _WIN32
+                OVERLAPPED at = {};
+                at.Offset = (DWORD)offset;
+                at.OffsetHigh = (DWORD)(offset >> 32);
+
+                DWORD done = 0;
+                DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD)size;
+                if (!WriteFile(file, p, chunk, &done, &at)) return false;
+#else
+                ssize_t done = pwrite(fd, p, size, (off_t)offset);
+                if (done < 0 && errno == EINTR) continue;
+                if (done <= 0) return false;
+#endif
+                p += done;
+                offset += (uint64_t)done;
+                size -= (size_t)done;
+            }
+
+            return true;
+        }
+
+        uint64_t size()
+        {
+#ifdef _WIN32
+            LARGE_INTEGER size;
+            return GetFileSizeEx(file, &size) ? (uint64_t)size.QuadPart : 0;
+#else
+            struct stat st;
+            return (fstat(fd, &st) == 0) ? (uint64_t)st.st_size : 0;
+#endif
+        }
+
+        bool sync()
+        {
+#ifdef _WIN32
+            return FlushFileBuffers(file) != 0;
+#else
+            return fsync(fd) == 0;
+#endif
+        }
+
+        bool isOpen() const
+        {
+#ifdef _WIN32
+            return file != INVALID_HANDLE_VALUE;
+#else
+            return fd >= 0;
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE file{ INVALID_HANDLE_VALUE };
+#else
+        int fd{ -1 };
+#endif
+    };
+
+    //flushes an already written file to disk
+    inline bool syncFile(const char* path)
+    {
+#ifdef _WIN32
+        HANDLE h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (h == INVALID_HANDLE_VALUE) return false;
+
+        bool synced = FlushFileBuffers(h) != 0;
+        CloseHandle(h);
+        return synced;
+#else
+        int fd = ::open(path, O_WRONLY);
+        if (fd < 0) return false;
+
+        bool synced = (fsync(fd) == 0);
+        ::close(fd);
+        return synced;
+#endif
+    }
+
+    //atomically moves from over to, replacing it if it exists
+    inline bool replaceFile(const char* from, const char* to)
+    {
+#ifdef _WIN32
+        return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        if (rename(from, to) != 0) return false;
+
+        //the rename itself is only durable once the directory is synced
+        std::string dir(to);
+        size_t slash = dir.find_last_of('/');
+        dir = (slash == std::string::npos) ? "." : dir.substr(0, slash + 1);
+
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        bool synced = (fsync(fd) == 0);
+        ::close(fd);
+        return synced;
+#endif
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace ds
+{
+    //read-only 2-3 tree over at most N keys, built in a constant expression so a constexpr instance lives in
+    //read-only data with no startup cost. the layout is the one TwoThreeTree::buildParallel produces: levels
+    //built bottom-up with as few nodes as possible, all nodes in one array and the children of a node
+    //adjacent, so only the index of the first child is stored
+    template <class T, size_t N>
+    class FrozenTree
+    {
+    public:
+        struct Node
+        {
+            T k1{}, k2{};
+            uint32_t n{ 0 };                    //number of keys
+            uint32_t first{ 0 };                //index of the left child, unused in leaves
+        };
+
+        //keys in any order, duplicates are dropped
+        constexpr explicit FrozenTree(const std::array<T, N>& input) : nodes(), keyCount(0), nodeCount(0), height(0), rootIndex(0)
+        {
+            std::array<T, N> level = input;
+            sort(level);
+
+            size_t m = 0;
+            for (size_t i = 0; i < N; i++)
+                if (m == 0 || level[m - 1] < level[i]) level[m++] = level[i];
+
+            keyCount = m;
+            if (m == 0) return;
+
+            size_t below = 0;                   //index of the first node of the level below
+            bool leaves = true;
+
+            while (true)
+            {
+                size_t g = (m <= 2) ? 1 : (m + 3) / 3;
+                size_t extra = m + 1 - 2 * g;   //number of 3-nodes, they come first
+                size_t start = nodeCount;
+                std::array<T, N> separators{};
+
+                for (size_t i = 0; i < g; i++)
+                {
+                    size_t off = 2 * i + ((i < extra) ? i : extra);
+                    Node& node = nodes[nodeCount++];
+
+                    node.n = (i < extra) ? 2 : 1;
+                    node.k1 = level[off];
+                    if (node.n == 2) node.k2 = level[off + 1];
+                    node.first = leaves ? 0 : (uint32_t)(below + off);
+
+                    if (i + 1 < g) separators[i] = level[off + node.n];
+                }
+
+                height++;
+
+                if (g == 1)
+                {
+                    rootIndex = start;
+                    return;
+                }
+
+                level = separators;
+                m = g - 1;
+                below = start;
+                leaves = false;
+            }
+        }
+
+        //dispatches on the height to a descent whose depth is a template argument, so its trip count is a
+        //constant and the compiler can unroll it into straight-line compares
+        constexpr bool contains(const T& key) const
+        {
+            return atHeight(key, std::make_index_sequence<MAX_HEIGHT>());
+        }
+
+        constexpr size_t size() const { return keyCount; }
+        constexpr size_t depth() const { return height; }
+
+        //calls fn(key) for every key in ascending order
+        template <class Fn>
+        void forEach(Fn fn) const
+        {
+            if (keyCount > 0) inorder(rootIndex, 1, fn);
+        }
+
+    private:
+        //tallest tree N keys can form: all 2-nodes, 2^h - 1 keys
+        static constexpr size_t maxHeight()
+        {
+            size_t h = 0;
+            while (((size_t)2 << h) - 1 <= N) h++;
+            return h;
+        }
+
+        static constexpr size_t MAX_HEIGHT = maxHeight();
+
+        template <size_t... H>
+        constexpr bool atHeight(const T& key, std::index_sequence<H...>) const
+        {
+            bool found = false;
+            (void)(((height == H + 1) && (found = descend<H + 1>(key), true)) || ...);
+            return found;
+        }
+
+        //Depth levels from the root without early exit, the child is picked arithmetically instead of by
+        //branches. leaves store first 0, so the index computed past the last level is never read
+        template <size_t Depth>
+        constexpr bool descend(const T& key) const
+        {
+            size_t r = rootIndex;
+            bool found = false;
+
+            for (size_t depth = 0; depth < Depth; depth++)
+            {
+                const Node& node = nodes[r];
+                bool two = (node.n == 2);
+
+                found |= (key == node.k1) | (two & (key == node.k2));
+                r = node.first + (size_t)!(key < node.k1) + (size_t)(two & !(key < node.k2));
+            }
+
+            return found;
+        }
+
+        //heap sort, std::sort is not constexpr before C++20
+        static constexpr void sort(std::array<T, N>& a)
+        {
+            for (size_t i = N / 2; i-- > 0;)
+                siftDown(a, i, N);
+
+            for (size_t end = N; end-- > 1;)
+            {
+                T top = a[0];
+                a[0] = a[end];
+                a[end] = top;
+                siftDown(a, 0, end);
+            }
+        }
+
+        static constexpr void siftDown(std::array<T, N>& a, size_t i, size_t end)
+        {
+            while (2 * i + 1 < end)
+            {
+                size_t c = 2 * i + 1;
+                if (c + 1 < end && a[c] < a[c + 1]) c++;
+                if (!(a[i] < a[c])) return;
+
+                T temp = a[i];
+                a[i] = a[c];
+                a[c] = temp;
+                i = c;
+            }
+        }
+
+        template <class Fn>
+        void inorder(size_t r, size_t depth, Fn& fn) const
+        {
+            const Node& node = nodes[r];
+            bool leaf = (depth == height);
+
+            if (!leaf) inorder(node.first, depth + 1, fn);
+            fn(node.k1);
+            if (!leaf) inorder(node.first + 1, depth + 1, fn);
+
+            if (node.n == 2)
+            {
+                fn(node.k2);
+                if (!leaf) inorder(node.first + 2, depth + 1, fn);
+            }
+        }
+
+    private:
+        std::array<Node, N> nodes;              //every node holds a distinct key, so N nodes always suffice
+        size_t keyCount;
+        size_t nodeCount;
+        size_t height;
+        size_t rootIndex;
+    };
+
+    //lets the key type and count be deduced: constexpr auto table = makeFrozenTree(std::array<int, 3>{ 5, 1, 3 });
+    template <class T, size_t N>
+    constexpr FrozenTree<T, N> makeFrozenTree(const std::array<T, N>& keys)
+    {
+        return FrozenTree<T, N>(keys);
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    //closed interval [lo, hi], ordered by lo then hi. reach is the largest hi in the subtree of the node the
+    //interval is the first key of, it is only meaningful there and is not part of the ordering or the hash
+    template <class E>
+    struct IntervalKey
+    {
+        E lo, hi;
+        E reach;
+
+        bool operator < (const IntervalKey& i) const { return lo < i.lo || (!(i.lo < lo) && hi < i.hi); }
+        bool operator > (const IntervalKey& i) const { return i < *this; }
+        bool operator == (const IntervalKey& i) const { return lo == i.lo && hi == i.hi; }
+    };
+
+    template <class E>
+    inline uint64_t keyHash(const IntervalKey<E>& key)
+    {
+        return keyHash(key.lo) ^ (keyHash(key.hi) * 0x9e3779b97f4a7c15ull);
+    }
+
+    //max-end augmentation, run by settle() on every node a change passed through. children are settled first,
+    //so their reach is current
+    template <class E>
+    inline void summarize(TwoThreeNode<IntervalKey<E>>& r)
+    {
+        E reach = r.k1.hi;
+
+        if (r.n == 2 && reach < r.k2.hi) reach = r.k2.hi;
+
+        TwoThreeNode<IntervalKey<E>>* children[3] = { r.left, r.middle, (r.n == 2) ? r.right : NULL };
+        for (auto c : children)
+            if (c != NULL && reach < c->k1.reach) reach = c->k1.reach;
+
+        r.k1.reach = reach;
+    }
+
+    //set of closed intervals in a TwoThreeTree keyed on their start. every node knows the largest end below
+    //it, kept by the same dirty-node bookkeeping as the Merkle hashes, so it survives every split, merge,
+    //rotation and eraseRange without extra work on the update path. queries skip subtrees that end before
+    //the query starts or start after it ends. every subtree still entered holds a reported interval or lies
+    //on the path to the query's end, so a query costs O(log n) when nothing overlaps and O(k log n) for k
+    //reported intervals, not the O(log n + k) of a tree that also sorts the intervals by end
+    template <class E>
+    class IntervalTree
+    {
+    public:
+        bool insert(E lo, E hi)
+        {
+            return tree.insert(IntervalKey<E>{ lo, hi, hi });
+        }
+
+        bool erase(E lo, E hi)
+        {
+            return tree.deleteNode(IntervalKey<E>{ lo, hi, hi });
+        }
+
+        bool contains(E lo, E hi)
+        {
+            return tree.searchFor(IntervalKey<E>{ lo, hi, hi }) != nullptr;
+        }
+
+        //calls fn(lo, hi) for every interval that shares a point with [a, b], ordered by start
+        template <class Fn>
+        void forOverlapping(E a, E b, Fn fn)
+        {
+            tree.rootHash();                    //settles the dirty nodes, bringing every reach up to date
+            overlapping(tree.root, a, b, fn);
+        }
+
+        //calls fn(lo, hi) for every interval containing x, ordered by start
+        template <class Fn>
+        void forStabbing(E x, Fn fn)
+        {
+            forOverlapping(x, x, fn);
+        }
+
+        //read from the tree, so it stays right after changes made through getTree() such as eraseRange. in
+        //write-buffered mode an operation counts once it reaches the leaves
+        size_t size() const
+        {
+            return tree.stats().keys;
+        }
+
+        void clear()
+        {
+            tree.clear();
+        }
+
+        TwoThreeTree<IntervalKey<E>>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        template <class Fn>
+        static void overlapping(TwoThreeNode<IntervalKey<E>>* r, const E& a, const E& b, Fn& fn)
+        {
+            if (r == NULL || r->k1.reach < a) return;
+
+            overlapping(r->left, a, b, fn);
+
+            if (b < r->k1.lo) return;           //everything from here on starts after b
+            if (!(r->k1.hi < a)) fn(r->k1.lo, r->k1.hi);
+
+            overlapping(r->middle, a, b, fn);
+
+            if (r->n == 2)
+            {
+                if (b < r->k2.lo) return;
+                if (!(r->k2.hi < a)) fn(r->k2.lo, r->k2.hi);
+
+                overlapping(r->right, a, b, fn);
+            }
+        }
+
+    private:
+        TwoThreeTree<IntervalKey<E>> tree;
+    };
+}
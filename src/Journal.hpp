@@ -0,0 +1,333 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "Snapshot.hpp"
+#include "File.hpp"
+
+namespace ds
+{
+    //<path>.log: header followed by batches, each batch being written and synced as a whole
+    struct JournalHeader
+    {
+        char magic[4];                          //"23TJ"
+        uint32_t version;
+        uint32_t keySize;
+        uint32_t reserved;
+    };
+
+    struct JournalBatch
+    {
+        uint32_t count;                         //records following the batch header
+        uint32_t reserved;
+        uint64_t checksum;                      //FNV-1a of the records, a torn batch fails it and ends the replay
+    };
+
+    const uint32_t JOURNAL_VERSION = 1;
+
+    //TwoThreeTree whose inserts and deletes are recorded in a write-ahead journal.
+    //records are one op byte followed by the raw key, and are synced in groups: a mutation is durable once
+    //the batch holding it is committed, either when groupSize records are pending or on commit().
+    //checkpoint() saves <path>.snap and empties the journal, open() loads the snapshot and replays the journal.
+    //a batch that fails to write is cut off the log and stays pending, and the mutation whose record completed
+    //it is undone and reports false. if the log cannot be cut back the journal fails and refuses mutations
+    template <class T>
+    class JournaledTree
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "journal records store keys as raw bytes");
+
+    public:
+        JournaledTree() = default;
+        JournaledTree(const JournaledTree&) = delete;
+        JournaledTree& operator=(const JournaledTree&) = delete;
+
+        ~JournaledTree()
+        {
+            close();
+        }
+
+        //recovers the tree stored under path, starting an empty one if there is none
+        bool open(const char* path)
+        {
+            close();
+
+            snapPath = std::string(path) + ".snap";
+            logPath = std::string(path) + ".log";
+            records.clear();
+            pendingCount = 0;
+            failed = false;
+
+            if (!recover()) return false;
+
+            sinceCheckpoint = 0;
+            return true;
+        }
+
+        //commits what is pending and closes the journal, the tree is kept in memory
+        void close()
+        {
+            if (!log.isOpen()) return;
+
+            commit();
+            log.close();
+        }
+
+        bool insert(T d)
+        {
+            //the record is only buffered here, so appending it after the tree changed keeps the log ahead of the disk
+            if (failed || !tree.insert(d)) return false;
+            if (append(d, false)) return true;
+
+            tree.deleteNode(d);
+            return false;
+        }
+
+        bool deleteNode(T d)
+        {
+            if (failed || !tree.deleteNode(d)) return false;
+            if (append(d, true)) return true;
+
+            tree.insert(d);
+            return false;
+        }
+
+        TwoThreeNode<T>* searchFor(T item)
+        {
+            return tree.searchFor(item);
+        }
+
+        //records per synced batch, 1 syncs every mutation
+        void setGroupCommit(size_t records)
+        {
+            groupSize = (records == 0) ? 1 : records;
+            if (pendingCount >= groupSize) commit();
+        }
+
+        //checkpoints automatically once this many records were committed since the last one, 0 never does
+        void setCheckpointInterval(size_t records)
+        {
+            checkpointInterval = records;
+        }
+
+        //writes and syncs the pending records as one batch, on failure they stay pending for the next commit
+        bool commit()
+        {
+            if (!writeBatch()) return false;
+            if (checkpointInterval > 0 && sinceCheckpoint >= checkpointInterval) return checkpoint();
+
+            return true;
+        }
+
+        //saves a snapshot of the tree and empties the journal.
+        //a crash between the two leaves the old journal next to the new snapshot, which is harmless:
+        //replay keeps the last operation per key, and the snapshot already reflects it
+        bool checkpoint()
+        {
+            if (!log.isOpen() || failed) return false;
+            if (!writeBatch()) return false;
+
+            std::string tmp = snapPath + ".tmp";
+
+            if (!saveSnapshot(tree, tmp.c_str())) return false;
+            if (!syncFile(tmp.c_str()) || !replaceFile(tmp.c_str(), snapPath.c_str())) return false;
+
+            sinceCheckpoint = 0;
+            if (reset()) return true;
+
+            //the snapshot holds every committed mutation, but the log can no longer be appended to
+            failed = true;
+            return false;
+        }
+
+        //true once a write error left the log in a state new batches cannot follow, mutations are refused
+        bool hasFailed() const
+        {
+            return failed;
+        }
+
+        TwoThreeTree<T>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        //buffers the record, false if it completed a batch that could not be written. the record is withdrawn
+        //then so the caller can undo its change, the records before it stay pending
+        bool append(const T& d, bool erase)
+        {
+            if (records.empty()) records.resize(sizeof(JournalBatch));   //batch header, filled in by writeBatch()
+
+            size_t at = records.size();
+            records.resize(at + RECORD_SIZE);
+            records[at] = erase ? 1 : 0;
+            memcpy(&records[at + 1], &d, sizeof(T));
+
+            if (++pendingCount < groupSize) return true;
+
+            if (!writeBatch())
+            {
+                records.resize((--pendingCount == 0) ? 0 : at);
+                return false;
+            }
+
+            //the batch is durable whether or not the checkpoint succeeds
+            if (checkpointInterval > 0 && sinceCheckpoint >= checkpointInterval) checkpoint();
+            return true;
+        }
+
+        bool writeBatch()
+        {
+            if (pendingCount == 0) return true;
+            if (failed) return false;
+
+            JournalBatch batch;
+            batch.count = (uint32_t)pendingCount;
+            batch.reserved = 0;
+            batch.checksum = snapshotChecksum(records.data() + sizeof(JournalBatch), records.size() - sizeof(JournalBatch));
+            memcpy(records.data(), &batch, sizeof(batch));
+
+            if (!log.write(records.data(), records.size()) || !log.sync())
+            {
+                //a partial batch would end the replay there and lose every batch after it, so the log is cut
+                //back to the last complete one before anything else is appended
+                if (!log.open(logPath.c_str(), durable)) failed = true;
+                return false;
+            }
+
+            durable += records.size();
+            sinceCheckpoint += pendingCount;
+            pendingCount = 0;
+            records.clear();
+            return true;
+        }
+
+        //starts a new journal holding only its header
+        bool reset()
+        {
+            JournalHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, "23TJ", 4);
+            header.version = JOURNAL_VERSION;
+            header.keySize = sizeof(T);
+
+            durable = sizeof(header);
+            return log.open(logPath.c_str(), 0) && log.write(&header, sizeof(header)) && log.sync();
+        }
+
+        //loads the snapshot, then applies the journal in bulk: the last operation per key decides whether the
+        //key exists, which is merged with the snapshot keys and handed to buildParallel in one go
+        bool recover()
+        {
+            std::vector<T> keys;
+
+            if (std::ifstream(snapPath, std::ios::binary))
+            {
+                SnapshotTree<T> snapshot;
+                if (!snapshot.openMmap(snapPath.c_str())) return false;     //never start over a snapshot we cannot read
+
+                snapshot.forEach([&keys](const T& key) { keys.push_back(key); });
+            }
+
+            std::vector<BufferedOp<T>> ops;
+            uint64_t valid = 0;
+
+            if (!readJournal(ops, valid)) return false;
+
+            if (ops.empty())
+            {
+                tree.buildParallel(keys.begin(), keys.end());
+            }
+            else
+            {
+                std::stable_sort(ops.begin(), ops.end(), [](const BufferedOp<T>& a, const BufferedOp<T>& b) { return a.key < b.key; });
+
+                std::vector<T> merged;
+                merged.reserve(keys.size() + ops.size());
+
+                size_t i = 0;
+                for (size_t j = 0; j < ops.size(); j++)
+                {
+                    if (j + 1 < ops.size() && ops[j].key == ops[j + 1].key) continue;   //a later operation on the key follows
+
+                    for (; i < keys.size() && keys[i] < ops[j].key; i++) merged.push_back(keys[i]);
+                    if (i < keys.size() && keys[i] == ops[j].key) i++;
+
+                    if (!ops[j].erase) merged.push_back(ops[j].key);
+                }
+
+                for (; i < keys.size(); i++) merged.push_back(keys[i]);
+
+                tree.buildParallel(merged.begin(), merged.end());
+            }
+
+            if (valid == 0) return reset();
+
+            //drops a torn batch at the end so new batches follow the last complete one
+            durable = valid;
+            return log.open(logPath.c_str(), valid);
+        }
+
+        //reads every complete batch, valid is set to the size of the journal up to the last of them
+        bool readJournal(std::vector<BufferedOp<T>>& ops, uint64_t& valid)
+        {
+            std::ifstream in(logPath, std::ios::binary | std::ios::ate);
+            if (!in) return true;
+
+            uint64_t size = (uint64_t)in.tellg();
+            in.seekg(0);
+
+            JournalHeader header;
+            if (!in.read((char*)&header, sizeof(header))) return true;     //never got past creation
+
+            if (memcmp(header.magic, "23TJ", 4) != 0 || header.version != JOURNAL_VERSION || header.keySize != sizeof(T))
+                return false;
+
+            valid = sizeof(header);
+
+            std::vector<char> data;
+            JournalBatch batch;
+
+            while (in.read((char*)&batch, sizeof(batch)))
+            {
+                if (batch.count > (size - valid - sizeof(batch)) / RECORD_SIZE) break;     //torn header
+
+                data.resize((size_t)batch.count * RECORD_SIZE);
+                if (!in.read(data.data(), data.size())) break;
+                if (snapshotChecksum(data.data(), data.size()) != batch.checksum) break;
+
+                for (size_t at = 0; at < data.size(); at += RECORD_SIZE)
+                {
+                    BufferedOp<T> op;
+                    memcpy(&op.key, &data[at + 1], sizeof(T));
+                    op.erase = (data[at] != 0);
+                    ops.push_back(op);
+                }
+
+                valid += sizeof(batch) + data.size();
+            }
+
+            return true;
+        }
+
+    private:
+        static const size_t RECORD_SIZE = 1 + sizeof(T);
+
+        TwoThreeTree<T> tree;
+        AppendFile log;
+        std::string snapPath, logPath;
+
+        std::vector<char> records;              //pending batch, header first
+        size_t pendingCount{ 0 };
+        size_t groupSize{ 128 };
+        size_t sinceCheckpoint{ 0 };
+        size_t checkpointInterval{ 0 };
+        uint64_t durable{ 0 };                  //log size up to the end of the last complete batch
+        bool failed{ false };
+    };
+}
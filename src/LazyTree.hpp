@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    //key plus tombstone flag, ordered by key only. the flag is part of the slot, so it moves with the key
+    //through every split and rotation
+    template <class T>
+    struct TombstoneKey
+    {
+        T key;
+        bool dead;
+
+        bool operator < (const TombstoneKey& k) const { return key < k.key; }
+        bool operator > (const TombstoneKey& k) const { return k.key < key; }
+        bool operator == (const TombstoneKey& k) const { return key == k.key; }
+    };
+
+    //the flag is left out so a key hashes the same dead or alive
+    template <class T>
+    inline uint64_t keyHash(const TombstoneKey<T>& k)
+    {
+        return keyHash(k.key);
+    }
+
+    //TwoThreeTree whose deletes only mark the key as a tombstone in place, a search plus a flag write with no
+    //merge or rotation. lookups and scans skip tombstones, inserting one revives it. once tombstones exceed
+    //the sweep fraction of the stored keys they are removed in bulk: each maximal run of adjacent tombstones
+    //is cut out with one eraseRange, or the tree is rebuilt from the live keys when the runs are too many
+    template <class T>
+    class LazyTree
+    {
+    public:
+        bool insert(T d)
+        {
+            TombstoneKey<T>* s = find(d);
+
+            if (s != nullptr)
+            {
+                if (!s->dead) return false;
+
+                s->dead = false;
+                deadCount--;
+                liveCount++;
+                return true;
+            }
+
+            tree.insert(TombstoneKey<T>{ d, false });
+            liveCount++;
+            return true;
+        }
+
+        bool deleteNode(T d)
+        {
+            TombstoneKey<T>* s = find(d);
+            if (s == nullptr || s->dead) return false;
+
+            s->dead = true;
+            deadKeys.push_back(d);
+            deadCount++;
+            liveCount--;
+
+            if (deadCount > sweepFraction * (liveCount + deadCount)) sweep();
+            return true;
+        }
+
+        bool searchFor(T d)
+        {
+            TombstoneKey<T>* s = find(d);
+            return s != nullptr && !s->dead;
+        }
+
+        //calls fn(key) for every live key in [lo, hi] in ascending order
+        template <class Fn>
+        void forRange(T lo, T hi, Fn fn)
+        {
+            tree.forRange(TombstoneKey<T>{ lo, false }, TombstoneKey<T>{ hi, false }, [&fn](const TombstoneKey<T>& k) { if (!k.dead) fn(k.key); });
+        }
+
+        template <class Fn>
+        void forEach(Fn fn)
+        {
+            tree.forEach([&fn](const TombstoneKey<T>& k) { if (!k.dead) fn(k.key); });
+        }
+
+        //fraction of tombstones among the stored keys that triggers a sweep, 1 leaves sweeping to the caller
+        void setSweepFraction(double fraction)
+        {
+            sweepFraction = fraction;
+        }
+
+        //physically removes every tombstone
+        void sweep()
+        {
+            if (deadCount == 0) return;
+
+            std::sort(deadKeys.begin(), deadKeys.end());
+            deadKeys.erase(std::unique(deadKeys.begin(), deadKeys.end()), deadKeys.end());
+
+            //keys revived since they were deleted are still listed
+            deadKeys.erase(std::remove_if(deadKeys.begin(), deadKeys.end(), [this](const T& k) { return !find(k)->dead; }), deadKeys.end());
+
+            //tombstones with nothing live between them form one run
+            std::vector<std::pair<T, T>> runs;
+            TombstoneKey<T> next;
+
+            for (size_t i = 0; i < deadKeys.size(); i++)
+            {
+                if (!runs.empty() && tree.successor(TombstoneKey<T>{ runs.back().second, true }, next) && next.key == deadKeys[i])
+                    runs.back().second = deadKeys[i];
+                else
+                    runs.push_back(std::make_pair(deadKeys[i], deadKeys[i]));
+            }
+
+            size_t depth = 1;
+            while (((size_t)1 << depth) < liveCount + deadCount) depth++;
+
+            if (runs.size() * depth < liveCount)
+            {
+                for (auto& run : runs)
+                    tree.eraseRange(TombstoneKey<T>{ run.first, true }, TombstoneKey<T>{ run.second, true });
+            }
+            else
+            {
+                std::vector<TombstoneKey<T>> live;
+                live.reserve(liveCount);
+                tree.forEach([&live](const TombstoneKey<T>& k) { if (!k.dead) live.push_back(k); });
+
+                tree.clear();
+                tree.buildParallel(live.begin(), live.end());
+            }
+
+            deadKeys.clear();
+            deadCount = 0;
+        }
+
+        void clear()
+        {
+            tree.clear();
+            deadKeys.clear();
+            liveCount = deadCount = 0;
+        }
+
+        size_t size() const { return liveCount; }
+        size_t tombstones() const { return deadCount; }
+
+        TwoThreeTree<TombstoneKey<T>>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        //slot holding d, dead or alive, nullptr if d is absent
+        TombstoneKey<T>* find(const T& d)
+        {
+            TwoThreeNode<TombstoneKey<T>>* r = tree.searchFor(TombstoneKey<T>{ d, false });
+            if (r == nullptr) return nullptr;
+
+            return (r->k1.key == d) ? &r->k1 : &r->k2;
+        }
+
+    private:
+        TwoThreeTree<TombstoneKey<T>> tree;
+        std::vector<T> deadKeys;                //keys tombstoned since the last sweep, may repeat or be revived
+        size_t liveCount{ 0 };
+        size_t deadCount{ 0 };
+        double sweepFraction{ 0.25 };
+    };
+}
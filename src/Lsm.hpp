@@ -0,0 +1,721 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "Bloom.hpp"
+#include "File.hpp"
+
+namespace ds
+{
+    //key plus tombstone flag, ordered by key only so a TwoThreeTree of them holds one entry per key
+    template <class T>
+    struct LsmEntry
+    {
+        T key;
+        bool erase;
+
+        bool operator < (const LsmEntry& e) const { return key < e.key; }
+        bool operator > (const LsmEntry& e) const { return e.key < key; }
+        bool operator == (const LsmEntry& e) const { return key == e.key; }
+    };
+
+    //the flag is left out, so a memtable lookup with erase false finds a tombstone by its key
+    template <class T>
+    inline uint64_t keyHash(const LsmEntry<T>& e)
+    {
+        return keyHash(e.key);
+    }
+
+    //run file: header, entries sorted by key, the first key of every block (fence pointers), then the blocks of
+    //a BlockedBloomFilter over the keyHash of every key, starting on a 64-byte boundary
+    struct RunHeader
+    {
+        char magic[4];                          //"23TL"
+        uint32_t version;
+        uint32_t keySize;
+        uint32_t entrySize;
+        uint64_t count;
+        uint64_t blockEntries;                  //entries per block, one fence key per block
+        uint64_t bloomWords;
+        uint32_t bloomHashes;
+        uint32_t reserved;
+        uint64_t fenceOffset;
+        uint64_t bloomOffset;
+    };
+
+    const uint32_t RUN_VERSION = 2;
+    const uint64_t LSM_BLOCK_BYTES = 4096;
+    const uint64_t LSM_BLOOM_BITS_PER_KEY = 10;
+
+    inline uint64_t runAlign(uint64_t offset, uint64_t to = 8)
+    {
+        return (offset + to - 1) & ~(to - 1);
+    }
+
+    //streams sorted entries into a run file
+    template <class T>
+    class RunWriter
+    {
+    public:
+        //expected is an upper bound on the entries added, it sizes the Bloom filter
+        bool open(const std::string& path, uint64_t expected)
+        {
+            out.open(path, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, "23TL", 4);
+            header.version = RUN_VERSION;
+            header.keySize = sizeof(T);
+            header.entrySize = sizeof(LsmEntry<T>);
+            header.blockEntries = (std::max)((uint64_t)1, LSM_BLOCK_BYTES / sizeof(LsmEntry<T>));
+            header.bloomWords = BlockedBloomFilter::blocksFor((size_t)expected, LSM_BLOOM_BITS_PER_KEY) * BlockedBloomFilter::BLOCK_WORDS;
+            header.bloomHashes = BlockedBloomFilter::PROBES;
+
+            bloom.assign((size_t)header.bloomWords, 0);
+            fences.clear();
+            chunk.clear();
+
+            out.write((const char*)&header, sizeof(header));    //rewritten by finish()
+            return (bool)out;
+        }
+
+        void add(const LsmEntry<T>& e)
+        {
+            if (header.count % header.blockEntries == 0) fences.push_back(e.key);
+
+            BlockedBloomFilter::add(bloom.data(), (size_t)(header.bloomWords / BlockedBloomFilter::BLOCK_WORDS), keyHash(e.key));
+
+            LsmEntry<T> entry;
+            memset(&entry, 0, sizeof(entry));   //no stray padding bytes on disk
+            entry.key = e.key;
+            entry.erase = e.erase;
+
+            chunk.push_back(entry);
+            header.count++;
+
+            if (chunk.size() == 4096)
+            {
+                out.write((const char*)chunk.data(), chunk.size() * sizeof(LsmEntry<T>));
+                chunk.clear();
+            }
+        }
+
+        bool finish()
+        {
+            static const char zeros[64] = {};
+
+            out.write((const char*)chunk.data(), chunk.size() * sizeof(LsmEntry<T>));
+            chunk.clear();
+
+            uint64_t end = sizeof(RunHeader) + header.count * sizeof(LsmEntry<T>);
+            header.fenceOffset = runAlign(end);
+            out.write(zeros, (std::streamsize)(header.fenceOffset - end));
+            out.write((const char*)fences.data(), fences.size() * sizeof(T));
+
+            end = header.fenceOffset + fences.size() * sizeof(T);
+            header.bloomOffset = runAlign(end, 64);        //the mapping starts on a page, so every block sits on a cache line
+            out.write(zeros, (std::streamsize)(header.bloomOffset - end));
+            out.write((const char*)bloom.data(), bloom.size() * sizeof(uint64_t));
+
+            out.seekp(0);
+            out.write((const char*)&header, sizeof(header));
+            out.close();
+
+            return !out.fail();
+        }
+
+        uint64_t count() const
+        {
+            return header.count;
+        }
+
+    private:
+        std::ofstream out;
+        RunHeader header;
+        std::vector<LsmEntry<T>> chunk;
+        std::vector<T> fences;
+        std::vector<uint64_t> bloom;
+    };
+
+    //immutable sorted run served from a read-only mapping. the file is removed once the run is obsolete
+    //and the last reader lets go of it
+    template <class T>
+    class LsmRun
+    {
+    public:
+        uint64_t id{ 0 };                       //file name
+        uint64_t seq{ 0 };                      //recency, a higher seq shadows a lower one
+        uint32_t level{ 0 };
+        bool busy{ false };                     //taken by a compaction
+        bool obsolete{ false };
+        std::string path;
+
+        ~LsmRun()
+        {
+            file.close();
+            if (obsolete) std::remove(path.c_str());
+        }
+
+        bool open()
+        {
+            if (!file.open(path.c_str()) || file.size() < sizeof(RunHeader)) return false;
+
+            header = (const RunHeader*)file.data();
+
+            //every count is checked against the bytes left in the file before it is multiplied, so a corrupt
+            //header cannot wrap an offset computation around to a value that passes
+            uint64_t size = file.size();
+
+            bool valid = (memcmp(header->magic, "23TL", 4) == 0)
+                && (header->version == RUN_VERSION)
+                && (header->keySize == sizeof(T))
+                && (header->entrySize == sizeof(LsmEntry<T>))
+                && (header->blockEntries == (std::max)((uint64_t)1, LSM_BLOCK_BYTES / sizeof(LsmEntry<T>)))
+                && (header->bloomHashes == BlockedBloomFilter::PROBES)
+                && (header->count <= (size - sizeof(RunHeader)) / sizeof(LsmEntry<T>));
+
+            uint64_t fenceCount = valid ? (header->count + header->blockEntries - 1) / header->blockEntries : 0;
+
+            valid = valid
+                && (header->fenceOffset % 8 == 0)
+                && (header->fenceOffset >= sizeof(RunHeader) + header->count * sizeof(LsmEntry<T>))
+                && (header->fenceOffset <= size)
+                && (fenceCount <= (size - header->fenceOffset) / sizeof(T));
+
+            valid = valid
+                && (header->bloomOffset % 64 == 0)
+                && (header->bloomOffset >= header->fenceOffset + fenceCount * sizeof(T))
+                && (header->bloomOffset <= size)
+                && (header->bloomWords > 0)
+                && (header->bloomWords % BlockedBloomFilter::BLOCK_WORDS == 0)
+                && (header->bloomWords == (size - header->bloomOffset) / sizeof(uint64_t))
+                && ((size - header->bloomOffset) % sizeof(uint64_t) == 0);
+
+            if (!valid)
+            {
+                file.close();
+                return false;
+            }
+
+            entries = (const LsmEntry<T>*)(file.data() + sizeof(RunHeader));
+            fences = (const T*)(file.data() + header->fenceOffset);
+            fenceEnd = fences + fenceCount;
+            bloom = (const uint64_t*)(file.data() + header->bloomOffset);
+            return true;
+        }
+
+        bool mayContain(const T& key) const
+        {
+            return BlockedBloomFilter::mayContain(bloom, (size_t)(header->bloomWords / BlockedBloomFilter::BLOCK_WORDS), keyHash(key));
+        }
+
+        //entry of key, nullptr if the run has none. the Bloom filter is checked first, then the fences pick
+        //the single block the key can be in
+        const LsmEntry<T>* find(const T& key) const
+        {
+            if (fences == fenceEnd || !mayContain(key)) return nullptr;
+
+            const T* f = std::upper_bound(fences, fenceEnd, key);
+            if (f == fences) return nullptr;
+
+            uint64_t block = (uint64_t)(f - fences) - 1;
+            const LsmEntry<T>* first = entries + block * header->blockEntries;
+            const LsmEntry<T>* last = entries + (std::min)(header->count, (block + 1) * header->blockEntries);
+
+            const LsmEntry<T>* e = lowerBound(first, last, key);
+            return (e != last && e->key == key) ? e : nullptr;
+        }
+
+        //first entry not less than key
+        const LsmEntry<T>* lowerBound(const T& key) const
+        {
+            return lowerBound(begin(), end(), key);
+        }
+
+        //first entry greater than key
+        const LsmEntry<T>* upperBound(const T& key) const
+        {
+            return std::upper_bound(begin(), end(), key, [](const T& k, const LsmEntry<T>& e) { return k < e.key; });
+        }
+
+        const LsmEntry<T>* begin() const { return entries; }
+        const LsmEntry<T>* end() const { return entries + header->count; }
+        uint64_t count() const { return header->count; }
+
+    private:
+        static const LsmEntry<T>* lowerBound(const LsmEntry<T>* first, const LsmEntry<T>* last, const T& key)
+        {
+            return std::lower_bound(first, last, key, [](const LsmEntry<T>& e, const T& k) { return e.key < k; });
+        }
+
+    private:
+        MappedFile file;
+        const RunHeader* header{ nullptr };
+        const LsmEntry<T>* entries{ nullptr };
+        const T* fences{ nullptr };
+        const T* fenceEnd{ nullptr };
+        const uint64_t* bloom{ nullptr };
+    };
+
+    //log-structured merge store. writes go to a TwoThreeTree memtable which is written out as a sorted run
+    //once it holds memtableLimit keys. runs are size-tiered: fanIn runs of one level are merged into a run of
+    //the next level by background threads. reads check the memtable, then the runs from newest to oldest.
+    //
+    //the public functions are meant for a single thread, only compaction runs concurrently. the memtable is
+    //not journaled, close() writes it out but a crash loses it
+    template <class T>
+    class LsmTree
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "run files store keys as raw bytes");
+        static_assert(HasKeyHash<T>::value, "run filters hash the keys, add a keyHash overload for this key type");
+
+        typedef std::vector<std::shared_ptr<LsmRun<T>>> RunList;    //sorted by level, then newest first
+
+    public:
+        LsmTree() = default;
+        LsmTree(const LsmTree&) = delete;
+        LsmTree& operator=(const LsmTree&) = delete;
+
+        ~LsmTree()
+        {
+            close();
+        }
+
+        //opens the store kept in the existing directory dir
+        bool open(const char* path, unsigned compactionThreads = 1)
+        {
+            close();
+
+            dir = path;
+            nextId = 1;
+            nextSeq = 1;
+            compactionError = false;
+
+            auto list = std::make_shared<RunList>();
+            std::ifstream manifest(dir + "/MANIFEST");
+            uint64_t id, seq;
+            uint32_t level;
+
+            while (manifest >> id >> seq >> level)
+            {
+                auto run = std::make_shared<LsmRun<T>>();
+                run->id = id;
+                run->seq = seq;
+                run->level = level;
+                run->path = runPath(id);
+
+                if (!run->open()) return false;
+
+                list->push_back(run);
+                nextId = (std::max)(nextId, id + 1);
+                nextSeq = (std::max)(nextSeq, seq + 1);
+            }
+
+            std::sort(list->begin(), list->end(), newerFirst);
+            runs = list;
+
+            stopping = false;
+            opened = true;
+
+            for (unsigned i = 0; i < (std::max)(1u, compactionThreads); i++)
+                workers.emplace_back([this]() { work(); });
+
+            return true;
+        }
+
+        //writes the memtable out and stops compaction, a compaction in progress is finished first
+        void close()
+        {
+            if (!opened) return;
+
+            flush();
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+
+            wake.notify_all();
+
+            for (auto& worker : workers)
+                worker.join();
+
+            workers.clear();
+            runs.reset();
+            opened = false;
+        }
+
+        //blind writes, nothing is read: the entry just shadows whatever older runs hold for d
+        void insert(T d)
+        {
+            put(d, false);
+        }
+
+        void deleteNode(T d)
+        {
+            put(d, true);
+        }
+
+        bool searchFor(T item)
+        {
+            LsmEntry<T> e{ item, false };
+            TwoThreeNode<LsmEntry<T>>* r = memtable.searchFor(e);
+
+            if (r != NULL) return !((r->k1 == e) ? r->k1 : r->k2).erase;
+
+            auto list = current();
+
+            for (auto& run : *list)
+            {
+                const LsmEntry<T>* found = run->find(item);
+                if (found != nullptr) return !found->erase;
+            }
+
+            return false;
+        }
+
+        //calls fn(key) for every key in [lo, hi] in ascending order, merging the memtable and every run
+        template <class Fn>
+        void forRange(T lo, T hi, Fn fn)
+        {
+            std::vector<LsmEntry<T>> fresh;
+            memtable.forRange(LsmEntry<T>{ lo, false }, LsmEntry<T>{ hi, false }, [&fresh](const LsmEntry<T>& e) { fresh.push_back(e); });
+
+            auto list = current();
+            std::vector<Cursor> sources;
+            sources.push_back(Cursor(fresh.data(), fresh.data() + fresh.size()));
+
+            for (auto& run : *list)
+                sources.push_back(Cursor(run->lowerBound(lo), run->upperBound(hi)));
+
+            merge(sources, [&fn](const LsmEntry<T>& e) { if (!e.erase) fn(e.key); });
+        }
+
+        //writes the memtable out as a new level 0 run
+        bool flush()
+        {
+            if (memtableSize == 0) return true;
+
+            auto run = std::make_shared<LsmRun<T>>();
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                run->id = nextId++;
+                run->seq = nextSeq++;
+            }
+
+            run->path = runPath(run->id);
+
+            RunWriter<T> writer;
+            if (!writer.open(run->path, memtableSize)) return false;
+
+            memtable.forEach([&writer](const LsmEntry<T>& e) { writer.add(e); });
+
+            if (!writer.finish() || !syncFile(run->path.c_str()) || !run->open())
+            {
+                run->obsolete = true;
+                return false;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+
+                auto list = std::make_shared<RunList>(*runs);
+                list->insert(list->begin(), run);
+
+                if (!install(list))
+                {
+                    run->obsolete = true;
+                    return false;
+                }
+            }
+
+            wake.notify_one();
+
+            memtable.clear();
+            memtableSize = 0;
+            return true;
+        }
+
+        //blocks until no compaction is running or waiting to run
+        void waitForCompaction()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            idle.wait(guard, [this]() { return active == 0 && !hasJob(); });
+        }
+
+        //keys the memtable holds before it is written out
+        void setMemtableLimit(size_t keys)
+        {
+            memtableLimit = (std::max)((size_t)1, keys);
+        }
+
+        //runs of one level merged at once, at least 2
+        void setFanIn(size_t runs)
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                fanIn = (std::max)((size_t)2, runs);
+            }
+
+            wake.notify_all();
+        }
+
+        size_t runCount()
+        {
+            return current()->size();
+        }
+
+    private:
+        typedef std::pair<const LsmEntry<T>*, const LsmEntry<T>*> Cursor;
+
+        void put(const T& d, bool erase)
+        {
+            LsmEntry<T> e{ d, erase };
+            TwoThreeNode<LsmEntry<T>>* r = memtable.searchFor(e);
+
+            if (r != NULL)
+            {
+                ((r->k1 == e) ? r->k1 : r->k2).erase = erase;   //only the flag differs, no need to restructure
+                return;
+            }
+
+            memtable.insert(e);
+
+            if (++memtableSize >= memtableLimit) flush();
+        }
+
+        std::string runPath(uint64_t id) const
+        {
+            return dir + "/" + std::to_string(id) + ".run";
+        }
+
+        static bool newerFirst(const std::shared_ptr<LsmRun<T>>& a, const std::shared_ptr<LsmRun<T>>& b)
+        {
+            return (a->level != b->level) ? (a->level < b->level) : (a->seq > b->seq);
+        }
+
+        std::shared_ptr<const RunList> current()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return runs;
+        }
+
+        //k-way merge of sorted cursors, sources[0] being the newest. fn gets the newest entry of every key
+        template <class Fn>
+        static void merge(std::vector<Cursor>& sources, Fn fn)
+        {
+            while (true)
+            {
+                int best = -1;
+
+                for (size_t i = 0; i < sources.size(); i++)
+                    if (sources[i].first != sources[i].second && (best < 0 || sources[i].first->key < sources[best].first->key))
+                        best = (int)i;
+
+                if (best < 0) return;
+
+                LsmEntry<T> e = *sources[best].first;
+
+                for (auto& s : sources)
+                    if (s.first != s.second && s.first->key == e.key) s.first++;
+
+                fn(e);
+            }
+        }
+
+        //rewrites the manifest for list and makes it current, caller holds the lock
+        bool install(const std::shared_ptr<RunList>& list)
+        {
+            std::string path = dir + "/MANIFEST";
+            std::string tmp = path + ".tmp";
+
+            {
+                std::ofstream manifest(tmp, std::ios::trunc);
+
+                for (auto& run : *list)
+                    manifest << run->id << ' ' << run->seq << ' ' << run->level << '\n';
+
+                manifest.close();
+                if (manifest.fail()) return false;
+            }
+
+            if (!syncFile(tmp.c_str()) || !replaceFile(tmp.c_str(), path.c_str())) return false;
+
+            runs = list;
+            return true;
+        }
+
+        //lowest level holding fanIn runs that are not being compacted, caller holds the lock
+        bool hasJob() const
+        {
+            std::vector<std::shared_ptr<LsmRun<T>>> inputs;
+            bool drop;
+
+            return pick(inputs, drop, false);
+        }
+
+        //takes the oldest fanIn idle runs of the lowest level that has that many. runs are ordered by level
+        //then recency, so they are adjacent in recency and the merged run can sit at the top of the next level.
+        //a level is skipped while an older run of it is still being compacted: the newer batch would reach the
+        //next level first and be read after the older runs left behind, bringing deleted keys back.
+        //tombstones are dropped when no older run remains that they could shadow. caller holds the lock
+        bool pick(std::vector<std::shared_ptr<LsmRun<T>>>& inputs, bool& drop, bool take = true) const
+        {
+            if (compactionError || runs == nullptr) return false;
+
+            const RunList& list = *runs;
+
+            for (size_t i = 0; i < list.size();)
+            {
+                size_t j = i;
+                while (j < list.size() && list[j]->level == list[i]->level) j++;
+
+                inputs.clear();
+                for (size_t k = i; k < j; k++)
+                    if (!list[k]->busy) inputs.push_back(list[k]);
+
+                bool olderBusy = false;
+                if (inputs.size() >= fanIn)
+                {
+                    inputs.erase(inputs.begin(), inputs.end() - fanIn);
+
+                    for (size_t k = i; k < j; k++)
+                        if (list[k]->busy && list[k]->seq < inputs.front()->seq) olderBusy = true;
+                }
+
+                if (inputs.size() >= fanIn && !olderBusy)
+                {
+                    uint64_t oldest = inputs.back()->seq;
+                    drop = true;
+
+                    for (size_t k = i; k < list.size(); k++)
+                        if (list[k]->level > list[i]->level || list[k]->seq < oldest) drop = false;
+
+                    if (take)
+                        for (auto& run : inputs) run->busy = true;
+
+                    return true;
+                }
+
+                i = j;
+            }
+
+            return false;
+        }
+
+        void work()
+        {
+            std::unique_lock<std::mutex> guard(lock);
+
+            while (true)
+            {
+                std::vector<std::shared_ptr<LsmRun<T>>> inputs;
+                bool drop = false;
+
+                if (!stopping && pick(inputs, drop))
+                {
+                    auto output = std::make_shared<LsmRun<T>>();
+                    output->id = nextId++;
+                    output->seq = inputs.front()->seq;
+                    output->level = inputs.front()->level + 1;
+                    output->path = runPath(output->id);
+                    active++;
+
+                    guard.unlock();
+                    bool merged = compact(inputs, output, drop);
+                    guard.lock();
+
+                    auto list = std::make_shared<RunList>();
+
+                    for (auto& run : *runs)
+                        if (std::find(inputs.begin(), inputs.end(), run) == inputs.end()) list->push_back(run);
+
+                    if (merged && !output->obsolete)
+                        list->insert(std::upper_bound(list->begin(), list->end(), output, newerFirst), output);
+
+                    if (merged && install(list))
+                    {
+                        for (auto& run : inputs) run->obsolete = true;
+                    }
+                    else
+                    {
+                        //leave the runs as they are and stop compacting rather than retry a failing write
+                        output->obsolete = true;
+                        compactionError = true;
+                    }
+
+                    for (auto& run : inputs) run->busy = false;
+
+                    active--;
+                    wake.notify_all();
+                    idle.notify_all();
+                    continue;
+                }
+
+                if (stopping) return;
+
+                wake.wait(guard);
+            }
+        }
+
+        //merges inputs (newest first) into output and opens it
+        bool compact(const std::vector<std::shared_ptr<LsmRun<T>>>& inputs, const std::shared_ptr<LsmRun<T>>& output, bool drop)
+        {
+            std::vector<Cursor> sources;
+            uint64_t expected = 0;
+
+            for (auto& run : inputs)
+            {
+                sources.push_back(Cursor(run->begin(), run->end()));
+                expected += run->count();
+            }
+
+            RunWriter<T> writer;
+            if (!writer.open(output->path, expected)) return false;
+
+            merge(sources, [&writer, drop](const LsmEntry<T>& e) { if (!drop || !e.erase) writer.add(e); });
+
+            if (!writer.finish()) return false;
+
+            if (writer.count() == 0)
+            {
+                output->obsolete = true;                //everything cancelled out, no run to install
+                return true;
+            }
+
+            return syncFile(output->path.c_str()) && output->open();
+        }
+
+    private:
+        std::string dir;
+        TwoThreeTree<LsmEntry<T>> memtable;
+        size_t memtableSize{ 0 };
+        size_t memtableLimit{ 1 << 16 };
+
+        std::mutex lock;                        //guards everything below
+        std::condition_variable wake, idle;
+        std::shared_ptr<const RunList> runs;
+        std::vector<std::thread> workers;
+        uint64_t nextId{ 1 };
+        uint64_t nextSeq{ 1 };
+        size_t fanIn{ 4 };
+        size_t active{ 0 };
+        bool stopping{ false };
+        bool opened{ false };
+        bool compactionError{ false };
+    };
+}
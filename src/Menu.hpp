@@ -5,6 +5,7 @@
 #include "backend/imgui_impl_opengl2.h"
 #include "Log.hpp"
 #include "TreeNodePositioning.hpp"
+#include "Workload.hpp"
 #include "font/font.hpp"
 
 class Menu
@@ -34,6 +35,8 @@ private:
 
     inline void printNodeList();
 
+    inline void applyWorkloadOp(const ds::WorkloadOp& op, bool verbose);
+
     //utils
     inline float ZOOM(const float val) const{
         return val * zoomScale;
@@ -138,6 +141,10 @@ private:
 
     ds::TwoThreeTree<int> tree;
 
+    //scripted key streams, restarting one also empties the tree so adversarial streams match its shape
+    ds::WorkloadConfig workloadConfig{ ds::KeyPattern::UNIFORM, 1, 100, 70, 20 };
+    ds::Workload workload{ workloadConfig };
+
     //tree node attribs
     ImVector<TreeNodePositioning::Node<int>*> nodeList;
     float siblingSpacing{50.f};
@@ -375,6 +382,49 @@ inline void Menu::renderControls()
         ImGui::EndTabItem();
     }
 
+    if (ImGui::BeginTabItem("Workload"))
+    {
+        static int pattern = 0;
+        static int seed = 1;
+        static int keySpace = 100;
+        static int insertPercent = 70;
+        static int deletePercent = 20;
+        static int runCount = 20;
+        ImGui::Combo("Pattern", &pattern, ds::KEY_PATTERN_NAMES, ds::KEY_PATTERN_COUNT);
+        ImGui::InputInt("Seed", &seed);
+        ImGui::InputInt("Key space", &keySpace);
+        ImGui::SliderInt("Insert %", &insertPercent, 0, 100);
+        ImGui::SliderInt("Delete %", &deletePercent, 0, 100 - insertPercent);
+        if (ImGui::Button("Restart"))
+        {
+            workloadConfig.pattern = (ds::KeyPattern)pattern;
+            workloadConfig.seed = (uint64_t)seed;
+            workloadConfig.keySpace = (std::max)(keySpace, 1);
+            workloadConfig.insertPercent = insertPercent;
+            workloadConfig.deletePercent = (std::min)(deletePercent, 100 - insertPercent);
+            workload.reset(workloadConfig);
+            tree.clear();
+            LOG("[%s] Restarted %s workload with seed %d\n", "Info", ds::KEY_PATTERN_NAMES[pattern], seed);
+            refreshNodeList();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Step"))
+        {
+            applyWorkloadOp(workload.next(), true);
+            refreshNodeList();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Run"))
+        {
+            for (int i = 0; i < runCount; i++) applyWorkloadOp(workload.next(), false);
+            LOG("[%s] Ran %d workload operations\n", "Info", runCount);
+            refreshNodeList();
+        }
+        ImGui::SameLine();
+        ImGui::InputInt("Operations", &runCount);
+        ImGui::EndTabItem();
+    }
+
     if (ImGui::BeginTabItem("Misc"))
     {
         if (ImGui::Button("Print tree")) printNodeList();
@@ -509,6 +559,20 @@ inline void Menu::printNodeList()
     }
 }
 
+inline void Menu::applyWorkloadOp(const ds::WorkloadOp& op, bool verbose)
+{
+    int key = (int)op.key;
+    bool ok;
+    const char* name;
+    switch (op.kind)
+    {
+    case ds::WorkloadOpKind::INSERT: ok = tree.insert(key); name = "Insert"; break;
+    case ds::WorkloadOpKind::REMOVE: ok = tree.deleteNode(key); name = "Remove"; break;
+    default: ok = tree.searchFor(key) != NULL; name = "Search"; break;
+    }
+    if (verbose) LOG("[%s] %s %d: %s\n", "Info", name, key, ok ? "done" : "no effect");
+}
+
 inline void Menu::setupStyle()
 {
     ImGuiStyle* style = &ImGui::GetStyle();
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    //key slot of a multiset, ordered by key only. the count is part of the slot, so it moves with the key
+    //through every split, merge and rotation
+    template <class T>
+    struct CountedKey
+    {
+        T key;
+        size_t count;
+
+        bool operator < (const CountedKey& c) const { return key < c.key; }
+        bool operator > (const CountedKey& c) const { return c.key < key; }
+        bool operator == (const CountedKey& c) const { return key == c.key; }
+    };
+
+    //the count is left out, like the padding after it, so the Bloom filter and lookup cache see a key the same
+    //whatever its multiplicity
+    template <class T>
+    inline uint64_t keyHash(const CountedKey<T>& c)
+    {
+        return keyHash(c.key);
+    }
+
+    //the Merkle hashes do cover the count, so replicas agreeing on rootHash() hold the same multiplicities
+    template <class T>
+    inline uint64_t merkleHash(const CountedKey<T>& c)
+    {
+        return keyHash(c.key) ^ (keyHash(c.count) * 0x9e3779b97f4a7c15ull);
+    }
+
+    //TwoThreeTree that keeps duplicates: every key is stored once together with its multiplicity, so
+    //inserting a present key increments it in place and count() is a single O(log n) search
+    template <class T>
+    class TwoThreeMultiset
+    {
+    public:
+        //returns the multiplicity of d after the insert
+        size_t insert(T d)
+        {
+            CountedKey<T>* s = find(d);
+
+            if (s != nullptr)
+            {
+                total++;
+                s->count++;
+                tree.touch(*s);
+                return s->count;
+            }
+
+            tree.insert(CountedKey<T>{ d, 1 });
+            total++;
+            return 1;
+        }
+
+        //removes one occurrence of d, false if there is none
+        bool eraseOne(T d)
+        {
+            CountedKey<T>* s = find(d);
+            if (s == nullptr) return false;
+
+            if (s->count > 1)
+            {
+                s->count--;
+                tree.touch(*s);
+            }
+            else
+            {
+                tree.deleteNode(CountedKey<T>{ d, 0 });
+            }
+
+            total--;
+            return true;
+        }
+
+        //removes every occurrence of d, returns how many there were
+        size_t eraseAll(T d)
+        {
+            CountedKey<T>* s = find(d);
+            if (s == nullptr) return 0;
+
+            size_t removed = s->count;
+            tree.deleteNode(CountedKey<T>{ d, 0 });
+
+            total -= removed;
+            return removed;
+        }
+
+        size_t count(T d)
+        {
+            CountedKey<T>* s = find(d);
+            return (s != nullptr) ? s->count : 0;
+        }
+
+        //occurrences of all keys
+        size_t size() const
+        {
+            return total;
+        }
+
+        //calls fn(key, count) for every distinct key in [lo, hi] in ascending order
+        template <class Fn>
+        void forRange(T lo, T hi, Fn fn)
+        {
+            tree.forRange(CountedKey<T>{ lo, 0 }, CountedKey<T>{ hi, 0 }, [&fn](const CountedKey<T>& s) { fn(s.key, s.count); });
+        }
+
+        void clear()
+        {
+            tree.clear();
+            total = 0;
+        }
+
+        //rootHash() and diff() of the tree cover the keys with their counts, diff() reports a key whose count
+        //differs for both trees. a count changed in place through the tree needs touch() on its key
+        TwoThreeTree<CountedKey<T>>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        //slot holding d, nullptr if d is absent
+        CountedKey<T>* find(const T& d)
+        {
+            TwoThreeNode<CountedKey<T>>* r = tree.searchFor(CountedKey<T>{ d, 0 });
+            if (r == nullptr) return nullptr;
+
+            return (r->k1.key == d) ? &r->k1 : &r->k2;
+        }
+
+    private:
+        TwoThreeTree<CountedKey<T>> tree;
+        size_t total{ 0 };
+    };
+}
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "BufferPool.hpp"
+
+namespace ds
+{
+    //page 0 of a paged tree file
+    struct PagedMeta
+    {
+        char magic[4];                          //"23TP"
+        uint32_t version;
+        uint32_t keySize;
+        uint32_t pageSize;
+        uint64_t root;
+        uint64_t pageCount;
+        uint64_t freeHead;                      //first page of the free list, 0 if empty
+        uint64_t keyCount;
+    };
+
+    //start of every node page, followed by the keys and, in internal pages, the child page numbers
+    struct PageNode
+    {
+        uint16_t leaf;
+        uint16_t count;                         //number of keys
+        uint32_t reserved;
+    };
+
+    const uint32_t PAGED_VERSION = 1;
+
+    //disk-resident B+ tree: the 2-3 node generalized to a page holding as many keys as fit. keys live in the
+    //leaves, internal pages route with separators (a key equal to one goes right). pages are reached through a
+    //BufferPool, every access pins the page for as long as its handle lives.
+    //
+    //flush() writes everything back, the file is not crash-safe in between
+    template <class T>
+    class PagedTree
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "pages store keys as raw bytes");
+
+        static constexpr size_t align8(size_t offset) { return (offset + 7) & ~(size_t)7; }
+
+        static constexpr size_t LEAF_CAP = (POOL_PAGE_SIZE - sizeof(PageNode)) / sizeof(T);
+        static constexpr size_t INTERNAL_CAP = (POOL_PAGE_SIZE - sizeof(PageNode) - 8 - 7) / (sizeof(T) + 8);
+        static constexpr size_t CHILD_OFFSET = align8(sizeof(PageNode) + INTERNAL_CAP * sizeof(T));
+
+        static_assert(INTERNAL_CAP >= 3, "key type too large for a page");
+
+    public:
+        PagedTree() = default;
+        PagedTree(const PagedTree&) = delete;
+        PagedTree& operator=(const PagedTree&) = delete;
+
+        ~PagedTree()
+        {
+            close();
+        }
+
+        //opens or creates the tree stored in path, caching up to frames pages in memory
+        bool open(const char* path, size_t frames = 1024)
+        {
+            close();
+
+            if (!pool.open(path, frames)) return false;
+
+            if (pool.fileSize() == 0)
+            {
+                memset(&meta, 0, sizeof(meta));
+                memcpy(meta.magic, "23TP", 4);
+                meta.version = PAGED_VERSION;
+                meta.keySize = sizeof(T);
+                meta.pageSize = POOL_PAGE_SIZE;
+                meta.root = 1;
+                meta.pageCount = 2;
+
+                PageHandle root = pool.create(1);
+                node(root)->leaf = 1;
+
+                opened = true;
+                return flush();
+            }
+
+            PageHandle h = pool.fetch(0);
+            if (!h.valid()) return false;
+
+            memcpy(&meta, h.data(), sizeof(meta));
+
+            opened = (memcmp(meta.magic, "23TP", 4) == 0)
+                && (meta.version == PAGED_VERSION)
+                && (meta.keySize == sizeof(T))
+                && (meta.pageSize == POOL_PAGE_SIZE);
+
+            if (!opened)
+            {
+                h.release();
+                pool.close();
+            }
+
+            return opened;
+        }
+
+        bool close()
+        {
+            if (!opened) return true;
+
+            bool flushed = flush();
+            pool.close();
+            opened = false;
+            return flushed;
+        }
+
+        //writes the metadata and every dirty page back, then syncs
+        bool flush()
+        {
+            PageHandle h = pool.create(0);
+            if (!h.valid()) return false;
+
+            memcpy(h.data(), &meta, sizeof(meta));
+            h.release();
+
+            return pool.flush();
+        }
+
+        bool insert(T d)
+        {
+            Split up;
+            bool inserted = false;
+
+            if (!insert(meta.root, d, inserted, up)) return false;
+
+            if (up.happened)
+            {
+                PageHandle r = allocPage();
+                if (!r.valid()) return false;
+
+                node(r)->count = 1;
+                keys(r)[0] = up.sep;
+                children(r)[0] = meta.root;
+                children(r)[1] = up.right;
+                meta.root = r.page();
+            }
+
+            if (inserted) meta.keyCount++;
+            return inserted;
+        }
+
+        bool deleteNode(T d)
+        {
+            bool erased = false, underflow = false;
+
+            if (!erase(meta.root, d, erased, underflow)) return false;
+
+            PageHandle h = pool.fetch(meta.root);
+
+            if (h.valid() && !node(h)->leaf && node(h)->count == 0)   //root lost its last separator
+            {
+                uint64_t old = meta.root;
+                meta.root = children(h)[0];
+                h.release();
+                freePage(old);
+            }
+
+            if (erased) meta.keyCount--;
+            return erased;
+        }
+
+        bool searchFor(T item)
+        {
+            uint64_t page = meta.root;
+
+            while (true)
+            {
+                PageHandle h = pool.fetch(page);
+                if (!h.valid()) return false;
+
+                const T* k = keys(h);
+                const T* end = k + node(h)->count;
+
+                if (node(h)->leaf)
+                {
+                    const T* p = std::lower_bound(k, end, item);
+                    return (p != end) && (*p == item);
+                }
+
+                page = children(h)[std::upper_bound(k, end, item) - k];
+            }
+        }
+
+        //calls fn(key) for every key in [lo, hi] in ascending order. the children of an internal page are
+        //prefetched readAhead at a time ahead of the scan
+        template <class Fn>
+        bool forRange(T lo, T hi, Fn fn)
+        {
+            return range(meta.root, lo, hi, fn);
+        }
+
+        //pages prefetched ahead of a range scan, 0 turns read-ahead off
+        void setReadAhead(size_t pages)
+        {
+            readAhead = pages;
+        }
+
+        uint64_t size() const
+        {
+            return meta.keyCount;
+        }
+
+        BufferPool& bufferPool()
+        {
+            return pool;
+        }
+
+    private:
+        struct Split
+        {
+            bool happened{ false };
+            T sep{};                            //first key of the right page
+            uint64_t right{ 0 };
+        };
+
+        static PageNode* node(const PageHandle& h) { return (PageNode*)h.data(); }
+        static T* keys(const PageHandle& h) { return (T*)(h.data() + sizeof(PageNode)); }
+        static uint64_t* children(const PageHandle& h) { return (uint64_t*)(h.data() + CHILD_OFFSET); }
+
+        //pins a zeroed page, reusing a freed one first
+        PageHandle allocPage()
+        {
+            uint64_t page;
+
+            if (meta.freeHead != 0)
+            {
+                PageHandle h = pool.fetch(meta.freeHead);
+                if (!h.valid()) return PageHandle();
+
+                page = meta.freeHead;
+                memcpy(&meta.freeHead, h.data(), sizeof(uint64_t));
+            }
+            else
+            {
+                page = meta.pageCount++;
+            }
+
+            PageHandle h = pool.create(page);
+            if (h.valid()) h.markDirty();
+            return h;
+        }
+
+        //puts page on the free list, it must not be pinned
+        void freePage(uint64_t page)
+        {
+            PageHandle h = pool.create(page);
+            if (!h.valid()) return;
+
+            memcpy(h.data(), &meta.freeHead, sizeof(uint64_t));
+            meta.freeHead = page;
+        }
+
+        //inserts d below page. a split of page hands back the separator and the new right sibling in up.
+        //returns false on an I/O error
+        bool insert(uint64_t page, const T& d, bool& inserted, Split& up)
+        {
+            PageHandle h = pool.fetch(page);
+            if (!h.valid()) return false;
+
+            PageNode* n = node(h);
+            T* k = keys(h);
+            size_t count = n->count;
+
+            if (n->leaf)
+            {
+                size_t pos = std::lower_bound(k, k + count, d) - k;
+                if (pos < count && k[pos] == d) return true;
+
+                inserted = true;
+                h.markDirty();
+
+                if (count < LEAF_CAP)
+                {
+                    memmove(k + pos + 1, k + pos, (count - pos) * sizeof(T));
+                    k[pos] = d;
+                    n->count++;
+                    return true;
+                }
+
+                std::vector<T> all(k, k + count);
+                all.insert(all.begin() + pos, d);
+
+                PageHandle r = allocPage();
+                if (!r.valid()) return false;
+
+                size_t half = all.size() / 2;
+
+                memcpy(k, all.data(), half * sizeof(T));
+                n->count = (uint16_t)half;
+
+                node(r)->leaf = 1;
+                node(r)->count = (uint16_t)(all.size() - half);
+                memcpy(keys(r), all.data() + half, (all.size() - half) * sizeof(T));
+
+                up.happened = true;
+                up.sep = all[half];
+                up.right = r.page();
+                return true;
+            }
+
+            size_t idx = std::upper_bound(k, k + count, d) - k;
+
+            Split below;
+            if (!insert(children(h)[idx], d, inserted, below)) return false;
+            if (!below.happened) return true;
+
+            h.markDirty();
+            uint64_t* c = children(h);
+
+            if (count < INTERNAL_CAP)
+            {
+                memmove(k + idx + 1, k + idx, (count - idx) * sizeof(T));
+                memmove(c + idx + 2, c + idx + 1, (count - idx) * sizeof(uint64_t));
+                k[idx] = below.sep;
+                c[idx + 1] = below.right;
+                n->count++;
+                return true;
+            }
+
+            std::vector<T> ks(k, k + count);
+            std::vector<uint64_t> cs(c, c + count + 1);
+            ks.insert(ks.begin() + idx, below.sep);
+            cs.insert(cs.begin() + idx + 1, below.right);
+
+            PageHandle r = allocPage();
+            if (!r.valid()) return false;
+
+            size_t mid = ks.size() / 2;                 //moves up, the pages keep the keys on either side
+
+            memcpy(k, ks.data(), mid * sizeof(T));
+            memcpy(c, cs.data(), (mid + 1) * sizeof(uint64_t));
+            n->count = (uint16_t)mid;
+
+            node(r)->count = (uint16_t)(ks.size() - mid - 1);
+            memcpy(keys(r), ks.data() + mid + 1, (ks.size() - mid - 1) * sizeof(T));
+            memcpy(children(r), cs.data() + mid + 1, (cs.size() - mid - 1) * sizeof(uint64_t));
+
+            up.happened = true;
+            up.sep = ks[mid];
+            up.right = r.page();
+            return true;
+        }
+
+        //removes d below page, underflow tells the caller page fell below half full. returns false on an I/O error
+        bool erase(uint64_t page, const T& d, bool& erased, bool& underflow)
+        {
+            PageHandle h = pool.fetch(page);
+            if (!h.valid()) return false;
+
+            PageNode* n = node(h);
+            T* k = keys(h);
+            size_t count = n->count;
+
+            if (n->leaf)
+            {
+                size_t pos = std::lower_bound(k, k + count, d) - k;
+                if (pos == count || !(k[pos] == d)) return true;
+
+                memmove(k + pos, k + pos + 1, (count - pos - 1) * sizeof(T));
+                n->count--;
+                h.markDirty();
+
+                erased = true;
+                underflow = n->count < LEAF_CAP / 2;
+                return true;
+            }
+
+            size_t idx = std::upper_bound(k, k + count, d) - k;
+            bool below = false;
+
+            if (!erase(children(h)[idx], d, erased, below)) return false;
+
+            if (below)
+            {
+                if (!rebalance(h, idx)) return false;
+                underflow = n->count < INTERNAL_CAP / 2;
+            }
+
+            return true;
+        }
+
+        //fixes the underfull child idx of parent together with a sibling: both are merged when they fit in one
+        //page, otherwise their keys are split evenly between them
+        bool rebalance(PageHandle& parent, size_t idx)
+        {
+            size_t li = (idx > 0) ? idx - 1 : idx;
+            T* pk = keys(parent);
+            uint64_t* pc = children(parent);
+
+            PageHandle a = pool.fetch(pc[li]);
+            PageHandle b = pool.fetch(pc[li + 1]);
+            if (!a.valid() || !b.valid()) return false;
+
+            bool leaf = node(a)->leaf != 0;
+            size_t ca = node(a)->count, cb = node(b)->count;
+
+            //keys of both pages in order, with the parent separator between them for internal pages
+            std::vector<T> ks(keys(a), keys(a) + ca);
+            if (!leaf) ks.push_back(pk[li]);
+            ks.insert(ks.end(), keys(b), keys(b) + cb);
+
+            std::vector<uint64_t> cs;
+            if (!leaf)
+            {
+                cs.assign(children(a), children(a) + ca + 1);
+                cs.insert(cs.end(), children(b), children(b) + cb + 1);
+            }
+
+            a.markDirty();
+            parent.markDirty();
+
+            if (ks.size() <= (leaf ? LEAF_CAP : INTERNAL_CAP))
+            {
+                memcpy(keys(a), ks.data(), ks.size() * sizeof(T));
+                if (!leaf) memcpy(children(a), cs.data(), cs.size() * sizeof(uint64_t));
+                node(a)->count = (uint16_t)ks.size();
+
+                uint64_t old = b.page();
+                b.release();
+                freePage(old);
+
+                size_t count = node(parent)->count;
+                memmove(pk + li, pk + li + 1, (count - li - 1) * sizeof(T));
+                memmove(pc + li + 1, pc + li + 2, (count - li - 1) * sizeof(uint64_t));
+                node(parent)->count--;
+                return true;
+            }
+
+            b.markDirty();
+
+            size_t mid = ks.size() / 2;
+
+            if (leaf)
+            {
+                memcpy(keys(a), ks.data(), mid * sizeof(T));
+                memcpy(keys(b), ks.data() + mid, (ks.size() - mid) * sizeof(T));
+                node(a)->count = (uint16_t)mid;
+                node(b)->count = (uint16_t)(ks.size() - mid);
+                pk[li] = ks[mid];
+            }
+            else
+            {
+                memcpy(keys(a), ks.data(), mid * sizeof(T));
+                memcpy(children(a), cs.data(), (mid + 1) * sizeof(uint64_t));
+                memcpy(keys(b), ks.data() + mid + 1, (ks.size() - mid - 1) * sizeof(T));
+                memcpy(children(b), cs.data() + mid + 1, (cs.size() - mid - 1) * sizeof(uint64_t));
+                node(a)->count = (uint16_t)mid;
+                node(b)->count = (uint16_t)(ks.size() - mid - 1);
+                pk[li] = ks[mid];
+            }
+
+            return true;
+        }
+
+        template <class Fn>
+        bool range(uint64_t page, const T& lo, const T& hi, Fn& fn)
+        {
+            PageHandle h = pool.fetch(page);
+            if (!h.valid()) return false;
+
+            const T* k = keys(h);
+            const T* end = k + node(h)->count;
+
+            if (node(h)->leaf)
+            {
+                for (const T* p = std::lower_bound(k, end, lo); p != end && !(hi < *p); p++)
+                    fn(*p);
+
+                return true;
+            }
+
+            size_t first = std::upper_bound(k, end, lo) - k;
+            size_t last = std::upper_bound(k, end, hi) - k;
+            const uint64_t* c = children(h);
+            size_t window = first;
+
+            for (size_t i = first; i <= last; i++)
+            {
+                if (readAhead > 0 && i == window)
+                {
+                    window = (std::min)(last + 1, i + readAhead);
+                    pool.prefetch(std::vector<uint64_t>(c + i, c + window));
+                }
+
+                if (!range(c[i], lo, hi, fn)) return false;
+            }
+
+            return true;
+        }
+
+    private:
+        BufferPool pool;
+        PagedMeta meta{};
+        size_t readAhead{ 8 };
+        bool opened{ false };
+    };
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "File.hpp"
+
+namespace ds
+{
+    //on-disk image: header followed by the nodes in breadth-first order, the root being node 0
+    struct SnapshotHeader
+    {
+        char magic[4];                          //"23TS"
+        uint32_t version;
+        uint32_t keySize;                       //sizeof(T) the image was written with
+        uint32_t nodeSize;
+        uint64_t nodeCount;
+        uint64_t keyCount;
+        uint64_t checksum;                      //FNV-1a of the node array
+    };
+
+    template <class T>
+    struct SnapshotNode
+    {
+        T k1, k2;
+        uint32_t n;                             //number of keys
+        uint32_t left, middle, right;           //indices into the node array, 0 if there is no such child
+    };
+
+    const uint32_t SNAPSHOT_VERSION = 1;
+
+    inline uint64_t snapshotChecksum(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        const unsigned char* p = (const unsigned char*)data;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    //writes a snapshot of tree to path, buffered operations are applied first
+    template <class T, class Stats>
+    bool saveSnapshot(TwoThreeTree<T, Stats>& tree, const char* path)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot keys are stored as raw bytes");
+
+        tree.flushBuffers();
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "23TS", 4);
+        header.version = SNAPSHOT_VERSION;
+        header.keySize = sizeof(T);
+        header.nodeSize = sizeof(SnapshotNode<T>);
+        header.checksum = snapshotChecksum(NULL, 0);
+        out.write((const char*)&header, sizeof(header));    //rewritten once the counts are known
+
+        std::vector<const TwoThreeNode<T>*> level, next;
+        std::vector<SnapshotNode<T>> chunk;
+        uint64_t assigned = 1;                  //index the next child gets, nodes are written in the same order
+
+        if (tree.root != NULL) level.push_back(tree.root);
+
+        while (!level.empty())
+        {
+            for (auto r : level)
+            {
+                SnapshotNode<T> node;
+                memset(&node, 0, sizeof(node));  //padding and the unused key take part in the checksum
+
+                node.k1 = r->k1;
+                if (r->n == 2) node.k2 = r->k2;
+                node.n = r->n;
+
+                if (r->left != NULL)
+                {
+                    node.left = (uint32_t)assigned++;
+                    node.middle = (uint32_t)assigned++;
+                    next.push_back(r->left);
+                    next.push_back(r->middle);
+
+                    if (r->n == 2)
+                    {
+                        node.right = (uint32_t)assigned++;
+                        next.push_back(r->right);
+                    }
+                }
+
+                if (assigned > UINT32_MAX) return false;
+
+                chunk.push_back(node);
+                header.keyCount += r->n;
+
+                if (chunk.size() == 4096)
+                {
+                    header.checksum = snapshotChecksum(chunk.data(), chunk.size() * sizeof(SnapshotNode<T>), header.checksum);
+                    out.write((const char*)chunk.data(), chunk.size() * sizeof(SnapshotNode<T>));
+                    header.nodeCount += chunk.size();
+                    chunk.clear();
+                }
+            }
+
+            level.swap(next);
+            next.clear();
+        }
+
+        header.checksum = snapshotChecksum(chunk.data(), chunk.size() * sizeof(SnapshotNode<T>), header.checksum);
+        out.write((const char*)chunk.data(), chunk.size() * sizeof(SnapshotNode<T>));
+        header.nodeCount += chunk.size();
+
+        out.seekp(0);
+        out.write((const char*)&header, sizeof(header));
+        out.flush();
+
+        return (bool)out;
+    }
+
+    //read-only tree served straight from a mapped snapshot. the first insert or delete copies the keys
+    //into a regular TwoThreeTree and drops the mapping; a default constructed one is an empty mutable tree
+    template <class T>
+    class SnapshotTree
+    {
+    public:
+        SnapshotTree() = default;
+        SnapshotTree(const SnapshotTree&) = delete;
+        SnapshotTree& operator=(const SnapshotTree&) = delete;
+
+        //maps path, verify checks the checksum which reads the whole file once. the node structure is checked
+        //either way, so a truncated or corrupt image is rejected instead of read out of bounds
+        bool openMmap(const char* path, bool verify = true)
+        {
+            close();
+
+            if (!file.open(path)) return false;
+
+            const SnapshotHeader* h = (const SnapshotHeader*)file.data();
+
+            //the node count is compared by division so a huge one cannot wrap the product
+            bool valid = (file.size() >= sizeof(SnapshotHeader))
+                && (memcmp(h->magic, "23TS", 4) == 0)
+                && (h->version == SNAPSHOT_VERSION)
+                && (h->keySize == sizeof(T))
+                && (h->nodeSize == sizeof(SnapshotNode<T>))
+                && ((file.size() - sizeof(SnapshotHeader)) % sizeof(SnapshotNode<T>) == 0)
+                && (h->nodeCount == (file.size() - sizeof(SnapshotHeader)) / sizeof(SnapshotNode<T>));
+
+            if (valid && verify)
+                valid = (snapshotChecksum(file.data() + sizeof(SnapshotHeader), file.size() - sizeof(SnapshotHeader)) == h->checksum);
+
+            if (valid)
+                valid = validNodes((const SnapshotNode<T>*)(file.data() + sizeof(SnapshotHeader)), h->nodeCount, h->keyCount);
+
+            if (!valid)
+            {
+                file.close();
+                return false;
+            }
+
+            header = h;
+            nodes = (const SnapshotNode<T>*)(file.data() + sizeof(SnapshotHeader));
+            promoted = false;
+            return true;
+        }
+
+        void close()
+        {
+            file.close();
+            header = nullptr;
+            nodes = nullptr;
+            tree.clear();
+            promoted = true;
+        }
+
+        bool isMapped() const
+        {
+            return !promoted;
+        }
+
+        bool searchFor(T item)
+        {
+            if (promoted) return tree.searchFor(item) != nullptr;
+
+            const SnapshotNode<T>* r = (header->nodeCount > 0) ? nodes : nullptr;
+
+            while (r != nullptr)
+            {
+                uint32_t next;
+
+                if (item == r->k1 || (r->n == 2 && item == r->k2)) return true;
+
+                if (item < r->k1) next = r->left;
+                else if (r->n == 1 || item < r->k2) next = r->middle;
+                else next = r->right;
+
+                r = (next != 0) ? nodes + next : nullptr;
+            }
+
+            return false;
+        }
+
+        //calls fn(key) for every key in [lo, hi] in ascending order
+        template <class Fn>
+        void forRange(T lo, T hi, Fn fn)
+        {
+            if (promoted) tree.forRange(lo, hi, fn);
+            else if (header->nodeCount > 0) range(nodes, lo, hi, fn);
+        }
+
+        //calls fn(key) for every key in ascending order
+        template <class Fn>
+        void forEach(Fn fn)
+        {
+            if (promoted) tree.forEach(fn);
+            else if (header->nodeCount > 0) inorder(nodes, fn);
+        }
+
+        bool insert(T d)
+        {
+            return mutableTree().insert(d);
+        }
+
+        bool deleteNode(T d)
+        {
+            return mutableTree().deleteNode(d);
+        }
+
+        //copies the mapped keys into the owned tree on first use
+        TwoThreeTree<T>& mutableTree()
+        {
+            if (!promoted)
+            {
+                std::vector<T> keys;
+                keys.reserve((size_t)header->keyCount);
+
+                forEach([&keys](const T& key) { keys.push_back(key); });
+
+                file.close();
+                header = nullptr;
+                nodes = nullptr;
+                promoted = true;
+
+                tree.buildParallel(keys.begin(), keys.end());
+            }
+
+            return tree;
+        }
+
+    private:
+        //nodes are stored breadth-first, so the children of each node must be the next indices not yet taken.
+        //that keeps every index in the array and makes the image a tree: no cycles, no shared subtrees. a level
+        //must be all leaves or all internal nodes, which bounds the depth the traversals recurse to
+        static bool validNodes(const SnapshotNode<T>* nodes, uint64_t nodeCount, uint64_t keyCount)
+        {
+            uint64_t assigned = 1;
+            uint64_t levelStart = 0, levelEnd = 1;
+            uint64_t keys = 0;
+
+            for (uint64_t i = 0; i < nodeCount; i++)
+            {
+                if (i == levelEnd)
+                {
+                    levelStart = levelEnd;
+                    levelEnd = assigned;
+                }
+
+                const SnapshotNode<T>& r = nodes[i];
+                if (r.n != 1 && r.n != 2) return false;
+                if (i > levelStart && (r.left == 0) != (nodes[levelStart].left == 0)) return false;
+
+                keys += r.n;
+
+                if (r.left == 0)
+                {
+                    if (r.middle != 0 || r.right != 0) return false;
+                    continue;
+                }
+
+                if (r.left != assigned || r.middle != assigned + 1) return false;
+                assigned += 2;
+
+                if (r.n == 2)
+                {
+                    if (r.right != assigned) return false;
+                    assigned++;
+                }
+                else if (r.right != 0) return false;
+            }
+
+            return assigned == (std::max)(nodeCount, (uint64_t)1) && keys == keyCount;
+        }
+
+        const SnapshotNode<T>* child(uint32_t i) const
+        {
+            return (i != 0) ? nodes + i : nullptr;
+        }
+
+        template <class Fn>
+        void range(const SnapshotNode<T>* r, const T& lo, const T& hi, Fn& fn) const
+        {
+            if (r == nullptr) return;
+
+            if (lo < r->k1) range(child(r->left), lo, hi, fn);
+            if (!(r->k1 < lo) && !(hi < r->k1)) fn(r->k1);
+
+            if (r->k1 < hi && ((r->n == 1) || (lo < r->k2))) range(child(r->middle), lo, hi, fn);
+
+            if (r->n == 2)
+            {
+                if (!(r->k2 < lo) && !(hi < r->k2)) fn(r->k2);
+                if (r->k2 < hi) range(child(r->right), lo, hi, fn);
+            }
+        }
+
+        template <class Fn>
+        void inorder(const SnapshotNode<T>* r, Fn& fn) const
+        {
+            if (r == nullptr) return;
+
+            inorder(child(r->left), fn);
+            fn(r->k1);
+            inorder(child(r->middle), fn);
+
+            if (r->n == 2)
+            {
+                fn(r->k2);
+                inorder(child(r->right), fn);
+            }
+        }
+
+    private:
+        MappedFile file;
+        const SnapshotHeader* header{ nullptr };
+        const SnapshotNode<T>* nodes{ nullptr };
+        TwoThreeTree<T> tree;
+        bool promoted{ true };
+    };
+}
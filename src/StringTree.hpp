@@ -0,0 +1,414 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    //string key that points into a StringArena instead of owning its bytes, ordered like std::string. the first
+    //shared bytes are those at prefix, the rest are at tail. a front-coded key borrows prefix from an earlier key
+    //stored whole (shared 0), so a key is at most two pieces and a run common to many keys is stored once
+    struct StringKey
+    {
+        const char* prefix;
+        const char* tail;
+        uint32_t shared;
+        uint32_t size;                          //whole length, shared included
+
+        //longest contiguous run of bytes starting at byte i
+        std::string_view piece(size_t i) const
+        {
+            if (i < shared) return std::string_view(prefix + i, shared - i);
+            return std::string_view(tail + (i - shared), size - i);
+        }
+
+        void appendTo(std::string& out) const
+        {
+            if (shared > 0) out.append(prefix, shared);
+            out.append(tail, size - shared);
+        }
+
+        bool operator < (const StringKey& s) const;
+        bool operator > (const StringKey& s) const { return s < *this; }
+        bool operator == (const StringKey& s) const;
+    };
+
+    //key viewing s in place, for lookups
+    inline StringKey stringKey(std::string_view s)
+    {
+        return StringKey{ NULL, s.data(), 0, (uint32_t)s.size() };
+    }
+
+    //three-way comparison of a and b, both known to agree on the first skip bytes. common receives the length of
+    //their common prefix. keys whose first pieces start at the same bytes (a stored key and the keys borrowing
+    //from it) agree on the shorter of the two pieces, so that much is skipped as well
+    inline int compareKeys(const StringKey& a, const StringKey& b, size_t skip, size_t& common)
+    {
+        size_t n = (std::min)(a.size, b.size);
+        size_t i = skip;
+
+        std::string_view headA = a.piece(0), headB = b.piece(0);
+        if (headA.data() == headB.data()) i = (std::max)(i, (std::min)(headA.size(), headB.size()));
+
+        while (i < n)
+        {
+            std::string_view x = a.piece(i), y = b.piece(i);
+            size_t m = (std::min)(x.size(), y.size());
+            size_t j = 0;
+
+            //eight bytes at a time up to the word holding the first difference, then byte by byte
+            for (uint64_t u, v; j + 8 <= m; j += 8)
+            {
+                memcpy(&u, x.data() + j, 8);
+                memcpy(&v, y.data() + j, 8);
+                if (u != v) break;
+            }
+
+            while (j < m && x[j] == y[j]) j++;
+            i += j;
+
+            if (j < m)
+            {
+                common = i;
+                return ((unsigned char)x[j] < (unsigned char)y[j]) ? -1 : 1;
+            }
+        }
+
+        common = n;
+        if (a.size == b.size) return 0;
+        return (a.size < b.size) ? -1 : 1;
+    }
+
+    inline bool StringKey::operator < (const StringKey& s) const
+    {
+        size_t common;
+        return compareKeys(*this, s, 0, common) < 0;
+    }
+
+    inline bool StringKey::operator == (const StringKey& s) const
+    {
+        size_t common;
+        return size == s.size && compareKeys(*this, s, 0, common) == 0;
+    }
+
+    //hashes the characters, not the pointers, so the Bloom filter and lookup cache of a TwoThreeTree<StringKey>
+    //see equal strings as equal keys however they are split. found by argument dependent lookup from keyHash
+    //calls in the tree
+    inline uint64_t keyHash(const StringKey& key)
+    {
+        uint64_t h = 14695981039346656037ull;
+
+        for (uint32_t i = 0; i < key.size; i++)
+        {
+            h ^= (unsigned char)((i < key.shared) ? key.prefix[i] : key.tail[i - key.shared]);
+            h *= 1099511628211ull;
+        }
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    //append-only storage for key bytes in large chunks, so keys cost no allocation of their own and never move
+    class StringArena
+    {
+    public:
+        static const size_t CHUNK_SIZE = 64 * 1024;
+
+        //stores s whole
+        StringKey intern(std::string_view s)
+        {
+            return StringKey{ NULL, store(s), 0, (uint32_t)s.size() };
+        }
+
+        //stores s after its first shared bytes, which it takes from base. base must hold those bytes in one
+        //piece: either it is stored whole or it borrows at least shared bytes itself
+        StringKey intern(std::string_view s, const StringKey& base, size_t shared)
+        {
+            const char* prefix = (base.shared == 0) ? base.tail : base.prefix;
+            return StringKey{ prefix, store(s.substr(shared)), (uint32_t)shared, (uint32_t)s.size() };
+        }
+
+        void clear()
+        {
+            chunks.clear();
+            tail = NULL;
+            free = 0;
+            reserved = 0;
+        }
+
+        size_t bytes() const
+        {
+            return reserved;
+        }
+
+    private:
+        const char* store(std::string_view s)
+        {
+            //takes no bytes, and before the first chunk there is no tail to point into
+            if (s.empty()) return "";
+
+            if (s.size() > CHUNK_SIZE)
+            {
+                chunks.emplace_back(new char[s.size()]);
+                memcpy(chunks.back().get(), s.data(), s.size());
+                reserved += s.size();
+                return chunks.back().get();
+            }
+
+            if (free < s.size())
+            {
+                //the current chunk stays behind the oversized ones, so keep a pointer to it
+                tail = new char[CHUNK_SIZE];
+                chunks.emplace_back(tail);
+                free = CHUNK_SIZE;
+                reserved += CHUNK_SIZE;
+            }
+
+            char* p = tail + (CHUNK_SIZE - free);
+            memcpy(p, s.data(), s.size());
+            free -= s.size();
+            return p;
+        }
+
+    private:
+        std::vector<std::unique_ptr<char[]>> chunks;
+        char* tail{ NULL };
+        size_t free{ 0 };
+        size_t reserved{ 0 };
+    };
+
+    //set of strings kept in a TwoThreeTree<StringKey> whose bytes live in one arena, front-coded: a new key is
+    //stored as the suffix after the run it shares with its predecessor or successor, borrowing the run from the
+    //neighbour's bytes. lookups skip the prefix every key of the current subtree is known to share with the
+    //query: with lo and hi the common prefix lengths of the query and the subtree's lower and upper bound keys,
+    //every key in between agrees with the query on the first min(lo, hi) bytes, so each comparison starts
+    //there. insert and erase find the key with the same descent, and the tree's own descents then compare the
+    //stored key, skipping the run it shares with every key borrowing from the same place
+    class StringTree
+    {
+    public:
+        //a shorter shared run is not worth the pointer that borrows it
+        static const size_t MIN_SHARED = 8;
+
+        StringTree() = default;
+        StringTree(const StringTree&) = delete;
+        StringTree& operator=(const StringTree&) = delete;
+
+        bool insert(std::string_view s)
+        {
+            Neighbours around;
+            if (find(s, around)) return false;
+
+            tree.insert(frontCode(s, around));
+            keyCount++;
+            keyBytes += s.size();
+            return true;
+        }
+
+        //the bytes of an erased key stay in the arena until shrink(), keys borrowing from them keep working
+        bool erase(std::string_view s)
+        {
+            Neighbours around;
+            if (!find(s, around)) return false;
+
+            tree.deleteNode(around.found);
+            keyCount--;
+            keyBytes -= s.size();
+            return true;
+        }
+
+        bool contains(std::string_view s) const
+        {
+            Neighbours around;
+            return find(s, around);
+        }
+
+        //calls fn(std::string_view) for every key in [lo, hi] in ascending order. the view is valid during the call
+        template <class Fn>
+        void forRange(std::string_view lo, std::string_view hi, Fn fn)
+        {
+            std::string buffer;
+
+            tree.forRange(stringKey(lo), stringKey(hi), [&fn, &buffer](const StringKey& k)
+                {
+                    buffer.clear();
+                    k.appendTo(buffer);
+                    fn(std::string_view(buffer));
+                });
+        }
+
+        template <class Fn>
+        void forEach(Fn fn)
+        {
+            std::string buffer;
+
+            tree.forEach([&fn, &buffer](const StringKey& k)
+                {
+                    buffer.clear();
+                    k.appendTo(buffer);
+                    fn(std::string_view(buffer));
+                });
+        }
+
+        //copies the live keys into a fresh arena, dropping the bytes of erased ones. in key order every key is
+        //front-coded against its predecessor, the neighbour it shares the most with
+        void shrink()
+        {
+            StringArena fresh;
+            std::vector<StringKey> keys;
+            keys.reserve(keyCount);
+
+            std::string previous, current;
+
+            tree.forEach([&](const StringKey& k)
+                {
+                    current.clear();
+                    k.appendTo(current);
+
+                    size_t common = 0;
+                    size_t limit = (std::min)(previous.size(), current.size());
+                    while (!keys.empty() && common < limit && previous[common] == current[common]) common++;
+
+                    size_t shared = keys.empty() ? 0 : borrowable(keys.back(), common);
+                    keys.push_back((shared > 0) ? fresh.intern(current, keys.back(), shared) : fresh.intern(current));
+                    previous.swap(current);
+                });
+
+            tree.clear();
+            tree.buildParallel(keys.begin(), keys.end());
+            arena = std::move(fresh);
+        }
+
+        void clear()
+        {
+            tree.clear();
+            arena.clear();
+            keyCount = 0;
+            keyBytes = 0;
+        }
+
+        size_t size() const
+        {
+            return keyCount;
+        }
+
+        //bytes held by the arena and bytes of the live keys, counted whole
+        size_t arenaBytes() const { return arena.bytes(); }
+        size_t liveBytes() const { return keyBytes; }
+
+        TwoThreeTree<StringKey>& getTree()
+        {
+            return tree;
+        }
+
+    private:
+        //what a descent learns about s: the stored key equal to it, or the closest keys on either side and the
+        //length of the prefix s shares with each
+        struct Neighbours
+        {
+            StringKey found{};
+            StringKey below{}, above{};
+            size_t lo{ 0 }, hi{ 0 };
+            bool hasBelow{ false }, hasAbove{ false };
+        };
+
+        bool find(std::string_view s, Neighbours& around) const
+        {
+            StringKey key = stringKey(s);
+
+            for (TwoThreeNode<StringKey>* r = tree.root; r != NULL;)
+            {
+                size_t skip = (std::min)(around.lo, around.hi);
+                size_t common;
+
+                int c = compareKeys(key, r->k1, skip, common);
+                if (c == 0)
+                {
+                    around.found = r->k1;
+                    return true;
+                }
+
+                if (c < 0)
+                {
+                    around.above = r->k1;
+                    around.hasAbove = true;
+                    around.hi = common;
+                    r = r->left;
+                    continue;
+                }
+
+                around.below = r->k1;
+                around.hasBelow = true;
+                around.lo = common;
+
+                if (r->n == 1)
+                {
+                    r = r->middle;
+                    continue;
+                }
+
+                c = compareKeys(key, r->k2, skip, common);
+                if (c == 0)
+                {
+                    around.found = r->k2;
+                    return true;
+                }
+
+                if (c < 0)
+                {
+                    around.above = r->k2;
+                    around.hasAbove = true;
+                    around.hi = common;
+                    r = r->middle;
+                }
+                else
+                {
+                    around.below = r->k2;
+                    around.hasBelow = true;
+                    around.lo = common;
+                    r = r->right;
+                }
+            }
+
+            return false;
+        }
+
+        //bytes a key sharing common leading bytes with neighbour should borrow from it, 0 to be stored whole.
+        //a neighbour that borrows itself only holds its borrowed run in one piece; when that leaves more than
+        //MIN_SHARED common bytes behind, the key is stored whole instead so the keys after it can borrow them
+        static size_t borrowable(const StringKey& neighbour, size_t common)
+        {
+            size_t usable = (neighbour.shared == 0) ? common : (std::min)(common, (size_t)neighbour.shared);
+
+            if (usable < MIN_SHARED || common - usable > MIN_SHARED) return 0;
+            return usable;
+        }
+
+        //s stored after the longest run it can borrow from a neighbour
+        StringKey frontCode(std::string_view s, const Neighbours& around)
+        {
+            size_t fromBelow = around.hasBelow ? borrowable(around.below, around.lo) : 0;
+            size_t fromAbove = around.hasAbove ? borrowable(around.above, around.hi) : 0;
+
+            if (fromBelow == 0 && fromAbove == 0) return arena.intern(s);
+            if (fromBelow >= fromAbove) return arena.intern(s, around.below, fromBelow);
+            return arena.intern(s, around.above, fromAbove);
+        }
+
+    private:
+        StringArena arena;
+        TwoThreeTree<StringKey> tree;
+        size_t keyCount{ 0 };
+        size_t keyBytes{ 0 };
+    };
+}
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "File.hpp"
+
+namespace ds
+{
+    //header of a trace file, followed by capacity fixed-size records used as a ring: record i of the stream
+    //is slot i % capacity, so once written exceeds capacity the file holds the last capacity operations
+    struct TraceHeader
+    {
+        char magic[4];                          //"23TR"
+        uint32_t version;
+        uint32_t keySize;
+        uint32_t flags;
+        uint64_t capacity;                      //records the ring holds
+        uint64_t written;                       //records ever written, the newest being written - 1
+    };
+
+    const uint32_t TRACE_VERSION = 1;
+    const uint32_t TRACE_TIMESTAMPS = 1;        //every record ends with the ns since the previous one
+
+    enum class TraceOp : uint8_t
+    {
+        INSERT = 0,
+        REMOVE,                                 //deleteNode
+        SEARCH
+    };
+
+    //a record is the op byte, with TRACE_RESULT set if the call returned true or found the key, the raw key,
+    //and with TRACE_TIMESTAMPS a uint32_t delta saturating at about 4 seconds
+    const uint8_t TRACE_RESULT = 0x80;
+
+    template <class T>
+    struct TraceRecord
+    {
+        TraceOp op;
+        bool result;
+        T key;
+        uint32_t delta;                         //ns since the previous record, 0 without timestamps
+    };
+
+    //appends operations to a trace ring file. records are gathered in memory and written a block at a time,
+    //so recording one costs a copy and, with timestamps, a clock read
+    template <class T>
+    class TraceRecorder
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "trace records store keys as raw bytes");
+
+    public:
+        static const size_t BLOCK_RECORDS = 4096;
+
+        TraceRecorder() = default;
+        TraceRecorder(const TraceRecorder&) = delete;
+        TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+        ~TraceRecorder()
+        {
+            close();
+        }
+
+        //starts an empty trace in path keeping the last capacity records
+        bool open(const char* path, uint64_t capacity, bool timestamps)
+        {
+            close();
+            failed = false;
+            if (capacity == 0 || !file.open(path)) return false;
+
+            header = TraceHeader{ { '2', '3', 'T', 'R' }, TRACE_VERSION, (uint32_t)sizeof(T), timestamps ? TRACE_TIMESTAMPS : 0u, capacity, 0 };
+            recordSize = 1 + sizeof(T) + (timestamps ? sizeof(uint32_t) : 0);
+            pending.clear();
+            pending.reserve(BLOCK_RECORDS * recordSize);
+            last = std::chrono::steady_clock::now();
+
+            if (!writeHeader())
+            {
+                file.close();
+                return false;
+            }
+
+            return true;
+        }
+
+        void record(TraceOp op, const T& key, bool result)
+        {
+            if (!file.isOpen()) return;
+
+            size_t at = pending.size();
+            pending.resize(at + recordSize);
+
+            char* p = pending.data() + at;
+            *p = (char)((uint8_t)op | (result ? TRACE_RESULT : 0));
+            std::memcpy(p + 1, &key, sizeof(T));
+
+            if (header.flags & TRACE_TIMESTAMPS)
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+                last = now;
+
+                uint32_t delta = (ns > (long long)UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+                std::memcpy(p + 1 + sizeof(T), &delta, sizeof(delta));
+            }
+
+            if (pending.size() >= BLOCK_RECORDS * recordSize) flush();
+        }
+
+        //writes the gathered records and the header, false on a write error in this or any earlier flush,
+        //including the ones record() runs when a block fills
+        bool flush()
+        {
+            if (!file.isOpen()) return false;
+
+            size_t count = pending.size() / recordSize;
+            size_t done = 0;
+
+            //a block is written in at most two pieces, before and after the wrap. with more records than the
+            //ring holds only the last capacity of them are written
+            if (count > header.capacity)
+            {
+                done = count - (size_t)header.capacity;
+                header.written += done;
+            }
+
+            bool ok = true;
+
+            while (done < count)
+            {
+                uint64_t slot = header.written % header.capacity;
+                size_t run = (size_t)(std::min)((uint64_t)(count - done), header.capacity - slot);
+
+                ok = ok && file.write(sizeof(TraceHeader) + slot * recordSize, pending.data() + done * recordSize, run * recordSize);
+                header.written += run;
+                done += run;
+            }
+
+            pending.clear();
+            if (!writeHeader() || !ok) failed = true;
+
+            return !failed;
+        }
+
+        //flushes and closes the file, false if any write since open failed
+        bool close()
+        {
+            if (!file.isOpen()) return !failed;
+
+            bool ok = flush();
+            file.close();
+            return ok;
+        }
+
+        //true once a write failed, the trace on disk is missing records from then on
+        bool hasFailed() const
+        {
+            return failed;
+        }
+
+        //records passed to record() since open
+        uint64_t written() const
+        {
+            return header.written + pending.size() / recordSize;
+        }
+
+        bool isOpen() const
+        {
+            return file.isOpen();
+        }
+
+    private:
+        bool writeHeader()
+        {
+            return file.write(0, &header, sizeof(header));
+        }
+
+    private:
+        BlockFile file;
+        TraceHeader header{};
+        size_t recordSize{ 0 };
+        std::vector<char> pending;
+        std::chrono::steady_clock::time_point last;
+        bool failed{ false };
+    };
+
+    //read-only view of a trace file, records numbered from the oldest one still in the ring
+    template <class T>
+    class TraceReader
+    {
+    public:
+        //false if path is not a trace of keys the size of T
+        bool open(const char* path)
+        {
+            if (!map.open(path) || map.size() < sizeof(TraceHeader)) return false;
+
+            std::memcpy(&header, map.data(), sizeof(header));
+            if (std::memcmp(header.magic, "23TR", 4) != 0 || header.version != TRACE_VERSION || header.keySize != sizeof(T) || header.capacity == 0)
+                return false;
+
+            recordSize = 1 + sizeof(T) + ((header.flags & TRACE_TIMESTAMPS) ? sizeof(uint32_t) : 0);
+            count = (std::min)(header.written, header.capacity);
+
+            //a recorder that died before its last flush leaves the header behind the data, never ahead of it.
+            //compared by division, a corrupt count must not wrap the product
+            return count <= (map.size() - sizeof(TraceHeader)) / recordSize;
+        }
+
+        uint64_t size() const { return count; }
+        bool hasTimestamps() const { return (header.flags & TRACE_TIMESTAMPS) != 0; }
+
+        //true when older records were overwritten, so the trace does not start from an empty tree
+        bool wrapped() const { return header.written > header.capacity; }
+
+        TraceRecord<T> at(uint64_t i) const
+        {
+            uint64_t slot = (header.written - count + i) % header.capacity;
+            const char* p = map.data() + sizeof(TraceHeader) + slot * recordSize;
+
+            TraceRecord<T> r;
+            r.op = (TraceOp)(*p & ~TRACE_RESULT);
+            r.result = (*p & TRACE_RESULT) != 0;
+            std::memcpy(&r.key, p + 1, sizeof(T));
+            r.delta = 0;
+            if (hasTimestamps()) std::memcpy(&r.delta, p + 1 + sizeof(T), sizeof(uint32_t));
+            return r;
+        }
+
+    private:
+        MappedFile map;
+        TraceHeader header{};
+        size_t recordSize{ 0 };
+        uint64_t count{ 0 };
+    };
+
+    //TwoThreeTree whose insert, deleteNode and searchFor calls are recorded into a trace
+    template <class T, class Stats = NoStats>
+    class TracedTree
+    {
+    public:
+        bool open(const char* path, uint64_t capacity, bool timestamps)
+        {
+            return recorder.open(path, capacity, timestamps);
+        }
+
+        bool close()
+        {
+            return recorder.close();
+        }
+
+        bool insert(T d)
+        {
+            bool ok = tree.insert(d);
+            recorder.record(TraceOp::INSERT, d, ok);
+            return ok;
+        }
+
+        bool deleteNode(T d)
+        {
+            bool ok = tree.deleteNode(d);
+            recorder.record(TraceOp::REMOVE, d, ok);
+            return ok;
+        }
+
+        TwoThreeNode<T>* searchFor(T d)
+        {
+            TwoThreeNode<T>* r = tree.searchFor(d);
+            recorder.record(TraceOp::SEARCH, d, r != NULL);
+            return r;
+        }
+
+        TwoThreeTree<T, Stats>& getTree()
+        {
+            return tree;
+        }
+
+        TraceRecorder<T>& getRecorder()
+        {
+            return recorder;
+        }
+
+    private:
+        TwoThreeTree<T, Stats> tree;
+        TraceRecorder<T> recorder;
+    };
+
+    const int TRACE_HISTOGRAM_BUCKETS = 40;
+
+    //one phase of a replay: latencies go into power-of-two buckets, bucket b counting ops that took less
+    //than 2^b ns and at least half that
+    struct TracePhase
+    {
+        uint64_t ops{ 0 };
+        uint64_t mismatches{ 0 };               //ops whose result differs from the recorded one
+        double seconds{ 0 };                    //replay time
+        double recordedSeconds{ 0 };            //time the ops took to arrive when recorded, 0 without timestamps
+        uint64_t sampled{ 0 };
+        uint64_t histogram[TRACE_HISTOGRAM_BUCKETS]{};
+
+        //upper bound in ns of the bucket holding quantile q of the sampled latencies
+        uint64_t quantile(double q) const
+        {
+            uint64_t rank = (uint64_t)(q * (double)sampled);
+            uint64_t seen = 0;
+
+            for (int b = 0; b < TRACE_HISTOGRAM_BUCKETS; b++)
+            {
+                seen += histogram[b];
+                if (seen > rank) return (uint64_t)1 << b;
+            }
+
+            return (uint64_t)1 << (TRACE_HISTOGRAM_BUCKETS - 1);
+        }
+    };
+
+    //re-executes records [begin, end) of the trace against tree as fast as it can, as one phase. one op in
+    //sampleEvery is timed on its own for the histogram, the rest only count towards the phase's throughput
+    template <class T, class Tree>
+    TracePhase replayTrace(const TraceReader<T>& trace, Tree& tree, uint64_t begin, uint64_t end, uint64_t sampleEvery = 8)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        if (end > trace.size()) end = trace.size();
+        if (sampleEvery == 0) sampleEvery = 1;
+
+        TracePhase phase;
+        uint64_t recordedNs = 0;
+
+        Clock::time_point start = Clock::now();
+
+        for (uint64_t i = begin; i < end; i++)
+        {
+            TraceRecord<T> r = trace.at(i);
+            bool sample = (i % sampleEvery) == 0;
+            Clock::time_point t;
+            if (sample) t = Clock::now();
+
+            bool ok;
+            switch (r.op)
+            {
+            case TraceOp::INSERT: ok = tree.insert(r.key); break;
+            case TraceOp::REMOVE: ok = tree.deleteNode(r.key); break;
+            default: ok = tree.searchFor(r.key) != NULL; break;
+            }
+
+            if (sample)
+            {
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count();
+                int b = 0;
+                while (b < TRACE_HISTOGRAM_BUCKETS - 1 && ((long long)1 << b) <= ns) b++;
+
+                phase.histogram[b]++;
+                phase.sampled++;
+            }
+
+            if (ok != r.result) phase.mismatches++;
+            recordedNs += r.delta;
+        }
+
+        phase.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        phase.recordedSeconds = recordedNs / 1e9;
+        phase.ops = (end > begin) ? end - begin : 0;
+        return phase;
+    }
+}
@@ -1,11 +1,28 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <memory_resource>
+#include <new>
+
+#include "Bloom.hpp"
+
 #ifdef _DEBUG
 #include <iostream>
 #endif // DEBUG
 
 namespace ds
 {
+    template <class T>
+    struct BufferedOp
+    {
+        T key;
+        bool erase;                             //pending delete if true, pending insert otherwise
+    };
+
     template <class T>
     struct TwoThreeNode
     {
@@ -14,12 +31,24 @@ namespace ds
         TwoThreeNode<T>* middle;                //pointers to children
         TwoThreeNode<T>* right;
         int n;                                 //number of keys
+        std::pmr::vector<BufferedOp<T>>* buffer{ NULL };  //pending operations for this subtree, internal nodes in write-buffered mode only
+        uint64_t hash{ 0 };                     //sum of merkleHash over the subtree, valid once the node is not dirty
+        bool dirty{ true };                     //set on every node a change passes through, a dirty node's parent is dirty too
+    };
+
+    template <class T>
+    struct NodeRegion
+    {
+        TwoThreeNode<T>* nodes;                 //contiguous block nodes are relocated into by compact()
+        size_t capacity;
+        size_t used;                            //slots handed out so far, in layout order
+        size_t live;                            //slots still holding a node of the tree
     };
 
     template <class T>
     struct RuntimeInfo
     {
-        T midValue{ NULL };
+        T midValue{};
         TwoThreeNode<T>* child;
 
         RuntimeInfo()
@@ -37,35 +66,120 @@ namespace ds
             child = c;
             midValue = m;
         }
+    };
 
-        template<class T>
-        RuntimeInfo<T> operator = (RuntimeInfo<T>& rti)
-        {
-            if (&rti != this)
-            {
-                child = rti.child;
-                midValue = rti.midValue;
-            }
+    template <class T>
+    struct LookupSlot
+    {
+        T key;
+        TwoThreeNode<T>* node;                  //NULL if the slot is empty
+    };
 
-            return *this;
-        }
+    //hash of one key in the Merkle hashes, keyHash by default. key types whose payload replicas must agree on
+    //overload it (CountedKey mixes in the count), keyHash itself stays on the fields that decide equality
+    template <class T>
+    inline uint64_t merkleHash(const T& key)
+    {
+        return keyHash(key);
+    }
 
-        template<class T>
-        RuntimeInfo(RuntimeInfo<T>& rti)
-        {
-            child = rti.child;
-            midValue = rti.midValue;
-        }
+    //called on a node whose hash settle() recomputes, after its children. does nothing by default, key types
+    //that keep a summary of the subtree in the node's first key overload it (IntervalKey)
+    template <class T>
+    inline void summarize(TwoThreeNode<T>&)
+    {
+    }
+
+    struct LookupCacheStats
+    {
+        uint64_t lookups;
+        uint64_t hits;
+        size_t slots;
     };
 
-    template <class T>
+    //hot-path counters of a TwoThreeTree instantiated with CountingStats
+    struct OpCounters
+    {
+        uint64_t lookups;                       //descents by searchFor
+        uint64_t comparisons;                   //keys examined by searches, including the ones inserts and deletes start with
+        uint64_t splits;
+        uint64_t merges;
+        uint64_t rotateLefts;
+        uint64_t rotateRights;
+        uint64_t allocations;                   //nodes
+        uint64_t frees;
+        uint64_t heightChanges;
+    };
+
+    //default statistics policy, its hook is empty and inlined away so an uninstrumented tree pays nothing
+    struct NoStats
+    {
+        void add(uint64_t OpCounters::*, uint64_t = 1) {}
+        OpCounters counters() const { return OpCounters{}; }
+        void reset() {}
+    };
+
+    struct CountingStats
+    {
+        void add(uint64_t OpCounters::* field, uint64_t n = 1) { ops.*field += n; }
+        OpCounters counters() const { return ops; }
+        void reset() { ops = OpCounters{}; }
+
+        OpCounters ops{};
+    };
+
+    //snapshot returned by TwoThreeTree::stats(), every field is kept up to date as the tree changes
+    struct TreeStats
+    {
+        size_t keys;                            //applied keys, operations still in write buffers are not counted
+        size_t nodes;
+        size_t twoNodes;
+        size_t threeNodes;
+        int height;
+        size_t bytes;                           //nodes, unused compaction slots, lookup cache and Bloom filter
+        OpCounters ops;                         //all zero unless the tree counts with CountingStats
+        BloomStats bloom;
+        LookupCacheStats cache;
+    };
+
+    template <class T, class Stats = NoStats>
     class TwoThreeTree
     {
     public:
         TwoThreeNode<T>* root;
 
+    private:
+        std::pmr::memory_resource* resource;        //every node, buffer and filter of the tree is allocated from it
+
+        size_t bufferCapacity{ 0 };                 //write-buffered mode is on when non-zero
+        std::pmr::vector<BufferedOp<T>> pending;    //operations pushed out of the lowest buffers, waiting to be applied
+
+        size_t nodeCount{ 0 };
+        size_t keyCount{ 0 };
+        int treeHeight{ 0 };
+        Stats counters;
+        std::pmr::vector<NodeRegion<T>> regions;    //blocks filled by compact(), freed once their last node is
+        int compactRegion{ -1 };                    //region of the layout pass in progress, -1 if none
+        bool hasCursor{ false };
+        T cursor{};                                 //largest key of the last leaf laid out
+
+        BlockedBloomFilter* bloom{ NULL };          //optional filter searchFor consults first
+        size_t bloomKeys{ 0 };                      //keys added since the filter was built
+        size_t bloomDeletes{ 0 };
+        BloomStats bloomCounters{};
+
+        std::pmr::vector<LookupSlot<T>> lookupCache;    //key -> node holding it, every valid slot's node holds its key
+        size_t cacheMask{ 0 };
+        LookupCacheStats cacheCounters{};
+
     public:
-        TwoThreeTree()
+        TwoThreeTree() : TwoThreeTree(std::pmr::get_default_resource())
+        {
+        }
+
+        //allocates from r instead of the default resource, for instance a monotonic_buffer_resource shared by
+        //several short-lived trees. r must outlive the tree
+        explicit TwoThreeTree(std::pmr::memory_resource* r) : resource(r), pending(r), regions(r), lookupCache(r)
         {
             root = NULL;
         }
@@ -76,6 +190,16 @@ namespace ds
             {
                 destroy(root);
             }
+
+            for (auto& region : regions)
+                freeRegion(region);
+
+            freeBloom();
+        }
+
+        std::pmr::memory_resource* getResource() const
+        {
+            return resource;
         }
 
         void destroy(TwoThreeNode<T>* r)
@@ -85,764 +209,2161 @@ namespace ds
                 destroy(r->left);
                 destroy(r->middle);
                 destroy(r->right);
-                delete r;
+                freeBuffer(r->buffer);
+                freeNode(r);
             }
         }
 
         bool insert(T d)
         {
-            auto temp = searchFor(d);
-
-            if (temp == nullptr) //d doesnt exist
+            if (bufferCapacity > 0) //write-buffered mode, d may only exist in a buffer
             {
-                TwoThreeNode<T>* p = root; //pointer to parent
-
-                RuntimeInfo<T> s1 = insert(root, d, p);
-
-                if (s1.child != NULL)
-                {
-                    TwoThreeNode<T>* temp = new TwoThreeNode<T>;
-
-                    temp->k1 = s1.midValue;
-                    temp->n = 1;
-
-                    temp->left = root;
-                    temp->middle = s1.child;
-
-                    temp->right = NULL;
-                    root = temp;
-                }
+                if (searchFor(d) != nullptr) return false;
 
+                bufferInsert(d);
                 return true;
             }
 
-            return false;
+            if (!_insert(d)) return false;
+
+            bloomInsert(d);
+            return true;
         }
 
         bool deleteNode(T d)
         {
-            if (searchFor(d) == nullptr) return false;
-            TwoThreeNode<T>* p = root;     //Parent pointer will be used for rotation and merging purposes
+            if (bufferCapacity > 0)
+            {
+                if (searchFor(d) == nullptr) return false;
 
-            _delete(root, d, p);
-            return true;
-        }
+                bufferDelete(d);
+                bloomDelete();
+                return true;
+            }
 
-        TwoThreeNode<T>* searchFor(T item)
-        {
-            return search(root, item);
-        }
+            if (!_erase(d)) return false;
 
-#ifdef _DEBUG
-        void print() {
-            _print(this->root);
-            std::cout << std::endl;
+            bloomDelete();
+            return true;
         }
-#endif
-
-    private:
-        enum class ROTATEDIR
-        {
-            IMPOSSIBLE = 0,
-            RIGHT,
-            LEFT
-        };
 
-        ROTATEDIR isRotationPossible(TwoThreeNode<T>* p, TwoThreeNode<T>* r)
+        //removes every key in [lo, hi] and returns how many there were. the tree is split at lo and at hi, the
+        //middle part is freed as a whole and the outer parts are joined again, so only the nodes along the two
+        //boundary paths are rebuilt: O(log n + k) instead of k deletes. buffered operations are applied first
+        size_t eraseRange(T lo, T hi)
         {
-            if (p != r)
-            {
-                if (p->n == 1)    //parent is a 2-node
-                {
-                    if (r->n == 0)
-                    {
-                        if ((p->left == r) && (p->middle->n == 2))
-                            return ROTATEDIR::LEFT;
-
-                        else if ((p->middle == r) && (p->left->n == 2))
-                            return ROTATEDIR::RIGHT;
-                    }
-                    else
-                    {
-                        if (!((p->left->n == 2) && (p->middle->n == 2)))
-                        {
-                            if (p->left == r)
-                                return ROTATEDIR::RIGHT;
-
-                            else
-                                return ROTATEDIR::LEFT;
-                        }
-                    }
-                }
-                else //parent is a 3-node
-                {
-                    if (r->n == 0)
-                    {
-                        if ((p->left == r) && (p->middle->n == 2))
-                        {
-                            return ROTATEDIR::LEFT;
-                        }
+            if (hi < lo || root == NULL) return 0;
+            if (bufferCapacity > 0) flushBuffers();
 
-                        else if (p->middle == r)
-                        {
-                            if (p->left->n == 2)
-                                return ROTATEDIR::RIGHT;
+            TwoThreeNode<T>* below, * rest, * inside, * above;
+            int hBelow, hRest, hInside, hAbove;
 
-                            else if (p->right->n == 2)
-                                return ROTATEDIR::LEFT;
-                        }
+            size_t removed = 0;
+            if (split(root, height(root), lo, below, hBelow, rest, hRest)) removed++;
+            if (split(rest, hRest, hi, inside, hInside, above, hAbove)) removed++;
 
-                        else
-                        {
-                            if (p->middle->n == 2)
-                                return ROTATEDIR::RIGHT;
-                        }
-                    }
-                    else                //If OVERFLOW had occured at r
-                    {
-                        if ((p->left == r) && (p->middle->n == 1))
-                            return ROTATEDIR::RIGHT;
+            auto counter = [&removed](const T&) { removed++; };
+            inorder(inside, counter);
+            destroy(inside);
 
+            if (below == NULL || above == NULL)
+            {
+                root = (below != NULL) ? below : above;
+            }
+            else
+            {
+                //the largest key left of the range becomes the separator the two parts are joined around
+                TwoThreeNode<T>* last = below;
+                while (last->left != NULL) last = (last->n == 1) ? last->middle : last->right;
+                T separator = (last->n == 1) ? last->k1 : last->k2;
 
-                        else if (p->middle == r)
-                        {
-                            if (p->left->n == 1)
-                                return ROTATEDIR::LEFT;
+                TwoThreeNode<T>* empty;
+                int hEmpty;
+                split(below, hBelow, separator, below, hBelow, empty, hEmpty);
 
-                            else if (p->right->n == 1)
-                                return ROTATEDIR::RIGHT;
-                        }
-                        else
-                        {
-                            if (p->middle->n == 1)
-                                return ROTATEDIR::LEFT;
-                        }
-                    }
-                }
+                int h;
+                root = join(below, hBelow, separator, above, hAbove, h);
             }
 
-            return ROTATEDIR::IMPOSSIBLE;
+            keyCount -= removed;
+            setHeight(height(root));
+            bloomDelete(removed);
+            return removed;
         }
 
-        RuntimeInfo<T> rotateRight(TwoThreeNode<T>* p, TwoThreeNode<T>* r, T d, TwoThreeNode<T>* child)
+        TwoThreeNode<T>* searchFor(T item)
         {
-            if (r->n == 0) //root is empty
+            bool cached = !lookupCache.empty() && (bufferCapacity == 0);
+
+            if (cached)
             {
-                if ((p->n == 2) && (p->right == r))
-                {
-                    r->k1 = p->k2;
-                    r->n = 1;
-                    p->k2 = p->middle->k2;
-                    p->middle->n = 1;
-                    p->right->left = p->middle->right;
-                }
-                else
+                LookupSlot<T>& slot = cacheSlot(item);
+                cacheCounters.lookups++;
+
+                if (slot.node != NULL && slot.key == item)
                 {
-                    r->k1 = p->k1;
-                    r->n = 1;
-                    p->k1 = p->left->k2;
-                    p->left->n = 1;
-                    p->middle->left = p->left->right;
+                    cacheCounters.hits++;
+                    return slot.node;
                 }
             }
-            else
+
+            if (bloom != NULL)
             {
-                if (p->n == 2 && p->middle == r)
+                bloomCounters.queries++;
+
+                if (!bloom->mayContain(keyHash(item)))
                 {
-                    p->right->k2 = p->right->k1;
-                    p->right->k1 = p->k2;
+                    bloomCounters.filtered++;
+                    return nullptr;
+                }
+            }
 
-                    if (d < r->k1)
-                    {
-                        p->k2 = r->k2;
-                        r->k2 = r->k1;
-                        r->k1 = d;
-                    }
-                    else if (d < r->k2)
-                    {
-                        p->k2 = r->k2;
-                        r->k2 = d;
-                    }
-                    else
-                    {
-                        p->k2 = d;
-                    }
+            counters.add(&OpCounters::lookups);
+            TwoThreeNode<T>* found = (bufferCapacity > 0) ? searchBuffered(item) : search(root, item);
 
-                    p->right->right = p->right->middle;
-                    p->right->middle = p->right->left;
-                    p->right->left = child;
-                    p->right->n = 2;
-                }
+            if (found == nullptr && bloom != NULL) bloomCounters.falsePositives++;
 
-                else
-                {
-                    p->middle->k2 = p->middle->k1;
-                    p->middle->k1 = p->k1;
-                    if (d < r->k1)
-                    {
-                        p->k1 = r->k2;
-                        r->k2 = r->k1;
-                        r->k1 = d;
-                    }
-                    else if (d < r->k2)
-                    {
-                        p->k1 = r->k2;
-                        r->k2 = d;
-                    }
-                    else
-                    {
-                        p->k1 = d;
-                    }
-                    p->middle->right = p->middle->middle;
-                    p->middle->middle = p->middle->left;
-                    p->middle->left = child;
-                    p->middle->n = 2;
-                }
+            if (found != nullptr && cached)
+            {
+                //the node's copy, not item, which may view memory the caller owns (StringKey)
+                LookupSlot<T>& slot = cacheSlot(item);
+                slot.key = (found->k1 == item) ? found->k1 : found->k2;
+                slot.node = found;
             }
 
-            return (NULL);
+            return found;
         }
 
-        RuntimeInfo<T> rotateLeft(TwoThreeNode<T>* p, TwoThreeNode<T>* r, T d, TwoThreeNode<T>* child)
+        //direct-mapped cache from recently found keys to their nodes, checked before any descent so a hot key
+        //costs one probe. slots is rounded up to a power of two, 0 turns the cache off. a slot is dropped before
+        //its key leaves the node (splits, merges, rotations, predecessor swaps, deletes, compaction).
+        //it is bypassed in write-buffered mode, where a buffered delete may hide a key its node still holds
+        void setLookupCache(size_t slots)
         {
-            if (r->n == 0) //root is empty
-            {
-                if ((p->n == 2) && (p->middle == r))
-                {
-                    r->k1 = p->k2;
-                    r->n = 1;
-                    p->k2 = p->right->k1;
-                    p->right->k1 = p->right->k2;
-                    p->right->n = 1;
-                    p->middle->middle = p->right->left;
-                    p->right->left = p->right->middle;
-                    p->right->middle = p->right->right;
-                }
+            static_assert(HasKeyHash<T>::value, "raw bytes of this key type do not decide equality, add a keyHash overload for it");
 
-                else
-                {
-                    r->k1 = p->k1;
-                    r->n = 1;
+            size_t size = 1;
+            while (size < slots) size <<= 1;
+
+            lookupCache.assign((slots == 0) ? 0 : size, LookupSlot<T>{ T{}, NULL });
+            cacheMask = lookupCache.empty() ? 0 : size - 1;
+            cacheCounters = LookupCacheStats{};
+        }
+
+        LookupCacheStats lookupCacheStats() const
+        {
+            LookupCacheStats stats = cacheCounters;
+            stats.slots = lookupCache.size();
+            return stats;
+        }
+
+        //O(1) snapshot of the shape, footprint and counters. a 3-node holds one key more than a 2-node, so how
+        //the nodes divide between the two follows from the key and node counts alone
+        TreeStats stats() const
+        {
+            TreeStats s{};
+            s.keys = keyCount;
+            s.nodes = nodeCount;
+            s.threeNodes = keyCount - nodeCount;
+            s.twoNodes = nodeCount - s.threeNodes;
+            s.height = treeHeight;
+
+            s.bytes = nodeCount * sizeof(TwoThreeNode<T>) + lookupCache.size() * sizeof(LookupSlot<T>);
+            for (auto& region : regions) s.bytes += (region.capacity - region.live) * sizeof(TwoThreeNode<T>);
+            if (bloom != NULL) s.bytes += sizeof(BlockedBloomFilter) + bloom->bits() / 8;
+
+            s.ops = counters.counters();
+            s.bloom = bloomStats();
+            s.cache = lookupCacheStats();
+            return s;
+        }
+
+        void resetCounters()
+        {
+            counters.reset();
+        }
+
+        //order- and shape-independent hash of the key set: the sum of merkleHash over every key. nodes keep the
+        //sum of their subtree, structural changes mark the nodes they touch and only those are recomputed here.
+        //fields merkleHash leaves out (padding, flags) can be written in place freely, writing one it covers
+        //(a multiset count) needs touch(). meant for replica comparison, not as a cryptographic digest
+        uint64_t rootHash()
+        {
+            static_assert(HasKeyHash<T>::value, "raw bytes of this key type do not decide equality, add a keyHash overload for it");
+
+            if (bufferCapacity > 0) flushBuffers();
+            return settle(root);
+        }
+
+        //calls fn(key, inThis) for every key held by exactly one of the trees, in no particular order. a key
+        //both hold with a different merkleHash (another count) is reported for each tree. only subtrees whose hash differs from other's hash over the same key range are descended into,
+        //so k differences cost about O(k log^2 n)
+        template <class Fn>
+        void diff(TwoThreeTree& other, Fn fn)
+        {
+            rootHash();
+            other.rootHash();
+
+            diffNode(root, NULL, NULL, other, fn);
+        }
+
+        //marks the path to d for rehashing, after a field merkleHash covers was changed in place through the
+        //node searchFor returned
+        void touch(const T& d)
+        {
+            for (TwoThreeNode<T>* r = root; r != NULL; r = route(r, d))
+            {
+                r->dirty = true;
+                if ((d == r->k1) || ((r->n == 2) && (d == r->k2))) return;
+            }
+        }
+
+        //keeps a blocked Bloom filter of the keys so searchFor rejects most absent keys without descending.
+        //the filter is sized for twice the keys, grows once they outnumber that, and is rebuilt from the tree
+        //once deletes account for more than a quarter of the keys it holds
+        void setBloomFilter(bool on)
+        {
+            static_assert(HasKeyHash<T>::value, "raw bytes of this key type do not decide equality, add a keyHash overload for it");
+
+            if (!on)
+            {
+                freeBloom();
+                return;
+            }
+
+            if (bloom == NULL)
+            {
+                void* p = resource->allocate(sizeof(BlockedBloomFilter), alignof(BlockedBloomFilter));
+                bloom = new (p) BlockedBloomFilter(resource);
+            }
+
+            rebuildBloom();
+        }
+
+        BloomStats bloomStats() const
+        {
+            BloomStats stats = bloomCounters;
+            stats.bits = (bloom != NULL) ? bloom->bits() : 0;
+
+            uint64_t absent = stats.filtered + stats.falsePositives;
+            stats.falsePositiveRate = (absent > 0) ? (double)stats.falsePositives / absent : 0.0;
+            return stats;
+        }
+
+        //write-buffered mode: internal nodes keep up to capacity pending inserts/deletes which are pushed
+        //one level down in a batch when the buffer overflows, and applied to the leaves in key order.
+        //searchFor applies a buffered insert of the key it finds, so the node it returns always holds the key.
+        //capacity 0 applies everything still buffered and turns the mode off
+        void setWriteBuffer(size_t capacity)
+        {
+            if (capacity == 0) flushBuffers();
+            bufferCapacity = capacity;
+        }
+
+        //queues an insert without checking whether d already exists, it is dropped when applied if it does
+        void bufferInsert(T d)
+        {
+            enqueue(BufferedOp<T>{ d, false });
+            bloomInsert(d);
+        }
+
+        //queues a delete without checking whether d exists
+        void bufferDelete(T d)
+        {
+            enqueue(BufferedOp<T>{ d, true });
+        }
+
+        //applies every buffered operation to the tree
+        void flushBuffers()
+        {
+            std::pmr::vector<BufferedOp<T>> ops(resource);
+            collectBuffers(root, ops);
+
+            //higher buffers hold newer operations and were collected first, keep the newest one per key
+            std::stable_sort(ops.begin(), ops.end(), [](const BufferedOp<T>& a, const BufferedOp<T>& b) { return a.key < b.key; });
+
+            for (size_t i = 0; i < ops.size(); i++)
+                if (i == 0 || !(ops[i].key == ops[i - 1].key)) pending.push_back(ops[i]);
+
+            applyPending();
+        }
+
+        void clear()
+        {
+            for (auto& slot : lookupCache) slot.node = NULL;
+
+            destroy(root);
+            root = NULL;
+            endCompaction();
+            keyCount = 0;
+            setHeight(0);
+
+            if (bloom != NULL) resetBloom(0);
+        }
+
+        //calls fn(key) for every key in [lo, hi] in ascending order, buffered operations are applied first
+        template <class Fn>
+        void forRange(T lo, T hi, Fn fn)
+        {
+            if (bufferCapacity > 0) flushBuffers();
+            range(root, lo, hi, fn);
+        }
+
+        //calls fn(key) for every key in ascending order, buffered operations are applied first
+        template <class Fn>
+        void forEach(Fn fn)
+        {
+            if (bufferCapacity > 0) flushBuffers();
+            inorder(root, fn);
+        }
+
+        //largest key not above key, false if there is none
+        bool floor(T key, T& result)
+        {
+            const T* lower, * upper;
+            if (neighbours(key, lower, upper)) result = key;
+            else if (lower != NULL) result = *lower;
+            else return false;
+
+            return true;
+        }
+
+        //smallest key not below key, false if there is none
+        bool ceiling(T key, T& result)
+        {
+            const T* lower, * upper;
+            if (neighbours(key, lower, upper)) result = key;
+            else if (upper != NULL) result = *upper;
+            else return false;
+
+            return true;
+        }
+
+        //largest key strictly below key, false if there is none
+        bool predecessor(T key, T& result)
+        {
+            const T* lower, * upper;
+            neighbours(key, lower, upper);
+            if (lower == NULL) return false;
+
+            result = *lower;
+            return true;
+        }
+
+        //smallest key strictly above key, false if there is none
+        bool successor(T key, T& result)
+        {
+            const T* lower, * upper;
+            neighbours(key, lower, upper);
+            if (upper == NULL) return false;
+
+            result = *upper;
+            return true;
+        }
+
+        //key closest to key, the lower one on a tie. T must support subtraction
+        bool nearest(T key, T& result)
+        {
+            const T* lower, * upper;
+            if (neighbours(key, lower, upper)) result = key;
+            else if (lower == NULL && upper == NULL) return false;
+            else if (lower == NULL) result = *upper;
+            else if (upper == NULL) result = *lower;
+            else result = (*upper - key < key - *lower) ? *upper : *lower;
+
+            return true;
+        }
+
+        //replaces the tree with the keys in [begin, end), duplicates are dropped.
+        //keys are sorted and deduplicated in parallel, then the tree is built bottom-up one level at a time,
+        //every node of a level being independent from its siblings
+        template <class Iter>
+        void buildParallel(Iter begin, Iter end, unsigned threads = std::thread::hardware_concurrency())
+        {
+            if (threads == 0) threads = 1;
+
+            std::pmr::vector<T> level(begin, end, resource);
+            parallelSort(level, threads);
+            parallelUnique(level, threads);
+
+            clear();
+
+            if (bloom != NULL)
+            {
+                resetBloom(level.size());
+                for (auto& key : level) bloom->add(keyHash(key));
+            }
+
+            if (level.empty()) return;
+
+            keyCount = level.size();
+            int levels = 0;
+
+            std::pmr::vector<TwoThreeNode<T>*> children(resource);  //nodes of the level below, empty while building leaves
+
+            while (true)
+            {
+                //split m keys into g nodes of 1 or 2 keys with a separator between neighbours,
+                //using as few nodes as possible; the separators form the keys of the next level
+                size_t m = level.size();
+                size_t g = (m <= 2) ? 1 : (m + 3) / 3;
+                size_t extra = m + 1 - 2 * g;           //number of 3-nodes, they come first
+
+                std::pmr::vector<TwoThreeNode<T>*> nodes(g, resource);
+                std::pmr::vector<T> separators(g - 1, resource);
+
+                //the resource need not be thread-safe, so nodes are allocated here and only filled in parallel
+                for (auto& node : nodes) node = newNode();
+
+                parallelFor(g, threads, [&](size_t lo, size_t hi)
+                    {
+                        for (size_t i = lo; i < hi; i++)
+                        {
+                            size_t off = 2 * i + (std::min)(i, extra);
+                            TwoThreeNode<T>* temp = nodes[i];
+
+                            temp->n = (i < extra) ? 2 : 1;
+                            temp->k1 = level[off];
+                            if (temp->n == 2) temp->k2 = level[off + 1];
+
+                            if (children.empty())
+                            {
+                                temp->left = temp->middle = temp->right = NULL;
+                            }
+                            else
+                            {
+                                temp->left = children[off];
+                                temp->middle = children[off + 1];
+                                temp->right = (temp->n == 2) ? children[off + 2] : NULL;
+                            }
+
+                            if (i + 1 < g) separators[i] = level[off + temp->n];
+                        }
+                    });
+
+                levels++;
+
+                if (g == 1)
+                {
+                    root = nodes[0];
+                    setHeight(levels);
+                    return;
+                }
+
+                level.swap(separators);
+                children.swap(nodes);
+            }
+        }
+
+        //relocates up to budget nodes into one contiguous block in depth-first order, so a search walks forward
+        //through memory. the pass resumes from the last leaf laid out and may be interleaved with any other
+        //operation; nodes created meanwhile left of the cursor wait for the next pass. returns true when the pass is over
+        bool compact(size_t budget = SIZE_MAX)
+        {
+            if (root == NULL)
+            {
+                endCompaction();
+                return true;
+            }
+
+            if (compactRegion < 0)
+            {
+                size_t capacity = nodeCount + nodeCount / 4 + 16;    //room for nodes split off during the pass
+                regions.push_back(NodeRegion<T>{ newRegion(capacity), capacity, 0, 0 });
+                compactRegion = (int)regions.size() - 1;
+                hasCursor = false;
+            }
+
+            while (budget > 0)
+            {
+                if (!compactStep(budget))
+                {
+                    endCompaction();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+#ifdef _DEBUG
+        void print() {
+            _print(this->root);
+            std::cout << std::endl;
+        }
+#endif
+
+    private:
+        bool _insert(T d)
+        {
+            auto temp = search(root, d);
+
+            if (temp == nullptr) //d doesnt exist
+            {
+                TwoThreeNode<T>* p = root; //pointer to parent
+
+                RuntimeInfo<T> s1 = insert(root, d, p);
+                keyCount++;
+
+                if (p == NULL) setHeight(1);
+
+                if (s1.child != NULL)
+                {
+                    TwoThreeNode<T>* temp = newNode();
+
+                    temp->k1 = s1.midValue;
+                    temp->n = 1;
+
+                    temp->left = root;
+                    temp->middle = s1.child;
+
+                    temp->right = NULL;
+                    root = temp;
+                    setHeight(treeHeight + 1);
+                }
+
+                return true;
+            }
+
+            return false;
+        }
+
+        bool _erase(T d)
+        {
+            if (search(root, d) == nullptr) return false;
+            if (!lookupCache.empty()) cacheSlot(d).node = NULL;
+            TwoThreeNode<T>* p = root;     //Parent pointer will be used for rotation and merging purposes
+
+            _delete(root, d, p);
+            keyCount--;
+            return true;
+        }
+
+        void setHeight(int h)
+        {
+            if (h != treeHeight) counters.add(&OpCounters::heightChanges);
+            treeHeight = h;
+        }
+
+        //one descent for the keys around x: lower receives the largest key below x and upper the smallest above
+        //it, NULL where there is none. every key passed on the way down narrows one of the two. returns
+        //whether x itself is in the tree, buffered operations are applied first
+        bool neighbours(const T& x, const T*& lower, const T*& upper)
+        {
+            if (bufferCapacity > 0) flushBuffers();
+
+            lower = upper = NULL;
+
+            for (TwoThreeNode<T>* r = root; r != NULL;)
+            {
+                const T* keys[2] = { &r->k1, &r->k2 };
+
+                int i = 0;
+                while (i < r->n && *keys[i] < x) lower = keys[i++];
+
+                if (i < r->n && *keys[i] == x)
+                {
+                    //the neighbours of a stored key are the last key left of it and the first key right of it
+                    if (i + 1 < r->n) upper = keys[i + 1];
+
+                    for (TwoThreeNode<T>* c = child(r, i); c != NULL; c = child(c, c->n))
+                        lower = (c->n == 2) ? &c->k2 : &c->k1;
+
+                    for (TwoThreeNode<T>* c = child(r, i + 1); c != NULL; c = c->left)
+                        upper = &c->k1;
+
+                    return true;
+                }
+
+                if (i < r->n) upper = keys[i];
+                r = child(r, i);
+            }
+
+            return false;
+        }
+
+        //levels below and including r, 0 for an empty tree
+        static int height(TwoThreeNode<T>* r)
+        {
+            int h = 0;
+            for (; r != NULL; r = r->left) h++;
+            return h;
+        }
+
+        //cuts the subtree r of height h into the keys below x (less, of height hLess) and above x (greater),
+        //true if x itself was there, it is dropped. r's nodes along the path of x are freed and the pieces
+        //hanging off that path are joined back together with the keys between them
+        bool split(TwoThreeNode<T>* r, int h, const T& x, TwoThreeNode<T>*& less, int& hLess, TwoThreeNode<T>*& greater, int& hGreater)
+        {
+            if (r == NULL)
+            {
+                less = greater = NULL;
+                hLess = hGreater = 0;
+                return false;
+            }
+
+            int n = r->n;
+            T keys[2] = { r->k1, r->k2 };
+            TwoThreeNode<T>* kids[3] = { r->left, r->middle, r->right };
+
+            freeBuffer(r->buffer);
+            freeNode(r);
+
+            int i = 0;
+            while (i < n && keys[i] < x) i++;
+
+            bool here = (i < n && keys[i] == x);
+            bool found = here;
+
+            if (here)
+            {
+                less = kids[i];
+                greater = kids[i + 1];
+                hLess = hGreater = h - 1;
+            }
+            else found = split(kids[i], h - 1, x, less, hLess, greater, hGreater);
+
+            for (int j = i - 1; j >= 0; j--)
+                less = join(kids[j], h - 1, keys[j], less, hLess, hLess);
+
+            for (int j = here ? i + 1 : i; j < n; j++)
+                greater = join(greater, hGreater, keys[j], kids[j + 1], h - 1, hGreater);
+
+            return found;
+        }
+
+        //tree of the keys of l, then k, then the keys of r, every key of l below k and every key of r above it.
+        //the shorter tree is hung off the facing spine of the taller one, splitting nodes upward as in an insert
+        TwoThreeNode<T>* join(TwoThreeNode<T>* l, int hl, const T& k, TwoThreeNode<T>* r, int hr, int& h)
+        {
+            TwoThreeNode<T>* extra = NULL;
+            T up{};
+
+            if (hl > hr) extra = joinRight(l, hl, k, r, hr, up);
+            else if (hr > hl) extra = joinLeft(r, hr, k, l, hl, up);
+
+            if (hl != hr && extra == NULL)
+            {
+                h = (std::max)(hl, hr);
+                return (hl > hr) ? l : r;
+            }
+
+            TwoThreeNode<T>* top = newNode();
+            top->n = 1;
+            top->right = NULL;
+
+            if (hl == hr)
+            {
+                top->k1 = k;
+                top->left = l;
+                top->middle = r;
+                h = hl + 1;
+            }
+            else
+            {
+                top->k1 = up;
+                top->left = (hl > hr) ? l : extra;
+                top->middle = (hl > hr) ? extra : r;
+                h = (std::max)(hl, hr) + 1;
+            }
+
+            return top;
+        }
+
+        //adds k and t as the last key and child of the subtree r, t being hr - ht - 1 levels shorter than r.
+        //returns the node split off the right of r, up receiving the key that goes above it, or NULL
+        TwoThreeNode<T>* joinRight(TwoThreeNode<T>* r, int hr, const T& k, TwoThreeNode<T>* t, int ht, T& up)
+        {
+            T key = k;
+            TwoThreeNode<T>* child = t;
+
+            r->dirty = true;
+
+            if (hr > ht + 1)
+            {
+                child = joinRight((r->n == 1) ? r->middle : r->right, hr - 1, k, t, ht, key);
+                if (child == NULL) return NULL;
+            }
+
+            if (r->n == 1)
+            {
+                r->k2 = key;
+                r->right = child;
+                r->n = 2;
+                return NULL;
+            }
+
+            forget(r);
+
+            TwoThreeNode<T>* s = newNode();
+            s->n = 1;
+            s->k1 = key;
+            s->left = r->right;
+            s->middle = child;
+            s->right = NULL;
+
+            up = r->k2;
+            r->n = 1;
+            r->right = NULL;
+            return s;
+        }
+
+        //adds t and k as the first child and key of the subtree r, mirror of joinRight. the node it returns
+        //is split off the left of r
+        TwoThreeNode<T>* joinLeft(TwoThreeNode<T>* r, int hr, const T& k, TwoThreeNode<T>* t, int ht, T& up)
+        {
+            T key = k;
+            TwoThreeNode<T>* child = t;
+
+            r->dirty = true;
+
+            if (hr > ht + 1)
+            {
+                child = joinLeft(r->left, hr - 1, k, t, ht, key);
+                if (child == NULL) return NULL;
+            }
+
+            if (r->n == 1)
+            {
+                r->k2 = r->k1;
+                r->k1 = key;
+                r->right = r->middle;
+                r->middle = r->left;
+                r->left = child;
+                r->n = 2;
+                return NULL;
+            }
+
+            forget(r);
+
+            TwoThreeNode<T>* s = newNode();
+            s->n = 1;
+            s->k1 = key;
+            s->left = child;
+            s->middle = r->left;
+            s->right = NULL;
+
+            up = r->k1;
+            r->k1 = r->k2;
+            r->left = r->middle;
+            r->middle = r->right;
+            r->right = NULL;
+            r->n = 1;
+            return s;
+        }
+
+        enum class ROTATEDIR
+        {
+            IMPOSSIBLE = 0,
+            RIGHT,
+            LEFT
+        };
+
+        ROTATEDIR isRotationPossible(TwoThreeNode<T>* p, TwoThreeNode<T>* r)
+        {
+            if (p != r)
+            {
+                if (p->n == 1)    //parent is a 2-node
+                {
+                    if (r->n == 0)
+                    {
+                        if ((p->left == r) && (p->middle->n == 2))
+                            return ROTATEDIR::LEFT;
+
+                        else if ((p->middle == r) && (p->left->n == 2))
+                            return ROTATEDIR::RIGHT;
+                    }
+                    else
+                    {
+                        if (!((p->left->n == 2) && (p->middle->n == 2)))
+                        {
+                            if (p->left == r)
+                                return ROTATEDIR::RIGHT;
+
+                            else
+                                return ROTATEDIR::LEFT;
+                        }
+                    }
+                }
+                else //parent is a 3-node
+                {
+                    if (r->n == 0)
+                    {
+                        if ((p->left == r) && (p->middle->n == 2))
+                        {
+                            return ROTATEDIR::LEFT;
+                        }
+
+                        else if (p->middle == r)
+                        {
+                            if (p->left->n == 2)
+                                return ROTATEDIR::RIGHT;
+
+                            else if (p->right->n == 2)
+                                return ROTATEDIR::LEFT;
+                        }
+
+                        else
+                        {
+                            if (p->middle->n == 2)
+                                return ROTATEDIR::RIGHT;
+                        }
+                    }
+                    else                //If OVERFLOW had occured at r
+                    {
+                        if ((p->left == r) && (p->middle->n == 1))
+                            return ROTATEDIR::RIGHT;
+
+
+                        else if (p->middle == r)
+                        {
+                            if (p->left->n == 1)
+                                return ROTATEDIR::LEFT;
+
+                            else if (p->right->n == 1)
+                                return ROTATEDIR::RIGHT;
+                        }
+                        else
+                        {
+                            if (p->middle->n == 1)
+                                return ROTATEDIR::LEFT;
+                        }
+                    }
+                }
+            }
+
+            return ROTATEDIR::IMPOSSIBLE;
+        }
+
+        RuntimeInfo<T> rotateRight(TwoThreeNode<T>* p, TwoThreeNode<T>* r, T d, TwoThreeNode<T>* child)
+        {
+            counters.add(&OpCounters::rotateRights);
+            forgetFamily(p);
+            touchFamily(p);
+
+            if (r->n == 0) //root is empty
+            {
+                if ((p->n == 2) && (p->right == r))
+                {
+                    r->k1 = p->k2;
+                    r->n = 1;
+                    p->k2 = p->middle->k2;
+                    p->middle->n = 1;
+                    r->middle = r->left;        //the only remaining child becomes the middle one
+                    r->left = p->middle->right;
+                    p->middle->right = NULL;
+                }
+                else
+                {
+                    r->k1 = p->k1;
+                    r->n = 1;
+                    p->k1 = p->left->k2;
+                    p->left->n = 1;
+                    r->middle = r->left;
+                    r->left = p->left->right;
+                    p->left->right = NULL;
+                }
+            }
+            else
+            {
+                TwoThreeNode<T>* moved = child;     //rightmost of the 4 children, moves to the right sibling
+
+                if (d < r->k1)
+                {
+                    moved = r->right;
+                    r->right = r->middle;
+                    r->middle = child;
+                }
+                else if (d < r->k2)
+                {
+                    moved = r->right;
+                    r->right = child;
+                }
+
+                if (p->n == 2 && p->middle == r)
+                {
+                    p->right->k2 = p->right->k1;
+                    p->right->k1 = p->k2;
+
+                    if (d < r->k1)
+                    {
+                        p->k2 = r->k2;
+                        r->k2 = r->k1;
+                        r->k1 = d;
+                    }
+                    else if (d < r->k2)
+                    {
+                        p->k2 = r->k2;
+                        r->k2 = d;
+                    }
+                    else
+                    {
+                        p->k2 = d;
+                    }
+
+                    p->right->right = p->right->middle;
+                    p->right->middle = p->right->left;
+                    p->right->left = moved;
+                    p->right->n = 2;
+                }
+
+                else
+                {
+                    p->middle->k2 = p->middle->k1;
+                    p->middle->k1 = p->k1;
+                    if (d < r->k1)
+                    {
+                        p->k1 = r->k2;
+                        r->k2 = r->k1;
+                        r->k1 = d;
+                    }
+                    else if (d < r->k2)
+                    {
+                        p->k1 = r->k2;
+                        r->k2 = d;
+                    }
+                    else
+                    {
+                        p->k1 = d;
+                    }
+                    p->middle->right = p->middle->middle;
+                    p->middle->middle = p->middle->left;
+                    p->middle->left = moved;
+                    p->middle->n = 2;
+                }
+            }
+
+            hoistChildren(p);
+            return (NULL);
+        }
+
+        RuntimeInfo<T> rotateLeft(TwoThreeNode<T>* p, TwoThreeNode<T>* r, T d, TwoThreeNode<T>* child)
+        {
+            counters.add(&OpCounters::rotateLefts);
+            forgetFamily(p);
+            touchFamily(p);
+
+            if (r->n == 0) //root is empty
+            {
+                if ((p->n == 2) && (p->middle == r))
+                {
+                    r->k1 = p->k2;
+                    r->n = 1;
+                    p->k2 = p->right->k1;
+                    p->right->k1 = p->right->k2;
+                    p->right->n = 1;
+                    p->middle->middle = p->right->left;
+                    p->right->left = p->right->middle;
+                    p->right->middle = p->right->right;
+                    p->right->right = NULL;
+                }
+
+                else
+                {
+                    r->k1 = p->k1;
+                    r->n = 1;
                     p->k1 = p->middle->k1;
                     p->middle->k1 = p->middle->k2;
                     p->middle->n = 1;
                     p->left->middle = p->middle->left;
                     p->middle->left = p->middle->middle;
                     p->middle->middle = p->middle->right;
+                    p->middle->right = NULL;
+                }
+            }
+            else
+            {
+                TwoThreeNode<T>* moved = r->left;   //leftmost of the 4 children, moves to the left sibling
+
+                if (d < r->k1)
+                {
+                    r->left = child;
+                }
+                else if (d < r->k2)
+                {
+                    r->left = r->middle;
+                    r->middle = child;
+                }
+                else
+                {
+                    r->left = r->middle;
+                    r->middle = r->right;
+                    r->right = child;
+                }
+
+                if (p->n == 2 && p->right == r) {
+                    p->middle->k2 = p->k2;
+
+                    if (d < r->k1)
+                    {
+                        p->k2 = d;
+                    }
+                    else if (d < r->k2)
+                    {
+                        p->k2 = r->k1;
+                        r->k1 = d;
+                    }
+                    else
+                    {
+                        p->k2 = r->k1;
+                        r->k1 = r->k2;
+                        r->k2 = d;
+                    }
+
+                    p->middle->right = moved;
+                    p->middle->n = 2;
+                }
+
+                else
+                {
+                    p->left->k2 = p->k1;
+
+                    if (d < r->k1)
+                    {
+                        p->k1 = d;
+                    }
+                    else if (d < r->k2)
+                    {
+                        p->k1 = r->k1;
+                        r->k1 = d;
+                    }
+                    else
+                    {
+                        p->k1 = r->k1;
+                        r->k1 = r->k2;
+                        r->k2 = d;
+                    }
+
+                    p->left->right = moved;
+                    p->left->n = 2;
+                }
+            }
+
+            hoistChildren(p);
+            return (NULL);
+        }
+
+        RuntimeInfo<T> insert(TwoThreeNode<T>*& r, T d, TwoThreeNode<T>* p)
+        {
+            if (r != nullptr) r->dirty = true;
+
+            if (r == nullptr)               //root is empty, insert as root, root becomes a 2-node
+            {
+                TwoThreeNode<T>* temp = newNode();
+
+                temp->k1 = d;
+                temp->left = temp->middle = temp->right = NULL;
+
+                temp->n = 1;
+                r = temp;
+
+                return (NULL);
+            }
+            else if (r->left == nullptr)  //root is a leaf node
+            {
+                if (r->n == 1)           //root is a 2-node, then make it a 3-node
+                {
+                    if (d < r->k1)
+                    {
+                        r->k2 = r->k1;
+                        r->k1 = d;
+                    }
+
+                    else
+                        r->k2 = d;
+
+                    r->n = 2;
+
+                    return (NULL);
+                }
+                else                        //root is a 3-node
+                {
+                    RuntimeInfo<T> s1;
+
+
+                    ROTATEDIR rd = isRotationPossible(p, r);
+
+                    if (rd == ROTATEDIR::RIGHT)
+                        s1 = rotateRight(p, r, d, NULL);
+
+                    else if (rd == ROTATEDIR::LEFT)
+                        s1 = rotateLeft(p, r, d, NULL);
+
+                    else
+                        s1 = split3node(r, d, NULL); //cant rotate, try splitting
+
+                    return s1;
+                }
+            }
+            else //root is a non-leaf node
+            {
+                if (r->n == 1) //root is a 2-node
+                {
+                    if (d < r->k1)
+                    {
+                        RuntimeInfo<T> s1 = insert(r->left, d, r);
+
+                        if (s1.child != nullptr)
+                        {
+                            r->k2 = r->k1;
+                            r->k1 = s1.midValue;
+
+                            r->right = r->middle;
+                            r->middle = s1.child;
+
+                            r->n = 2;
+                        }
+                    }
+                    else if (d > r->k1)
+                    {
+                        RuntimeInfo<T> s1 = insert(r->middle, d, r);
+
+                        if (s1.child != NULL)
+                        {
+                            r->k2 = s1.midValue;
+                            r->right = s1.child;
+                            r->n = 2;
+                        }
+                    }
+
+                    return (NULL);
+                }
+                else                            //root is a 3-node
+                {
+                    RuntimeInfo<T> s1;
+
+                    if (d < r->k1)
+                        s1 = insert(r->left, d, r);
+                    else if (d < r->k2)
+                        s1 = insert(r->middle, d, r);
+                    else
+                        s1 = insert(r->right, d, r);
+
+                    if (s1.child != NULL)
+                    {
+                        ROTATEDIR rd = isRotationPossible(p, r);
+
+                        if (rd == ROTATEDIR::RIGHT)
+                            s1 = rotateRight(p, r, s1.midValue, s1.child);
+
+                        else if (rd == ROTATEDIR::LEFT)
+                            s1 = rotateLeft(p, r, s1.midValue, s1.child);
+
+                        else
+                            s1 = split3node(r, s1.midValue, s1.child); //cant rotate, try splitting
+
+                        return s1;
+                    }
+
+                    return (NULL);
+                }
+            }
+        }
+
+        RuntimeInfo<T> split3node(TwoThreeNode<T>* current, T k, TwoThreeNode<T>* child)
+        {
+            counters.add(&OpCounters::splits);
+            forget(current);
+
+            T mid;
+            TwoThreeNode<T>* temp = newNode();
+            temp->n = 1;
+            temp->left = temp->middle = temp->right = NULL;
+
+            if (k < current->k1)
+            {
+                mid = current->k1;
+
+                temp->k1 = current->k2;
+                current->k1 = k;
+
+                if (current->left != NULL)
+                {
+                    temp->left = current->middle;
+                    temp->middle = current->right;
+                    current->middle = child;
+                }
+            }
+            else if (k < current->k2)
+            {
+                mid = k;
+
+                temp->k1 = current->k2;
+
+                if (current->left != NULL)
+                {
+                    temp->left = child;
+                    temp->middle = current->right;
+                }
+            }
+            else
+            {
+                mid = current->k2;
+
+                temp->k1 = k;
+
+                if (current->left != NULL)
+                {
+                    temp->left = current->right;
+                    temp->middle = child;
+                }
+            }
+
+            current->right = NULL;
+            current->n = 1;
+
+            if (current->buffer != NULL)    //buffered operations right of mid follow the keys into temp
+            {
+                auto& ops = *current->buffer;
+                for (size_t i = 0; i < ops.size();)
+                {
+                    if (mid < ops[i].key)
+                    {
+                        put(temp, ops[i], true);
+                        ops.erase(ops.begin() + i);
+                    }
+                    else i++;
+                }
+            }
+
+            RuntimeInfo<T> s1(temp, mid);
+            return s1;
+        }
+
+        RuntimeInfo<T> merge(TwoThreeNode<T>* p, TwoThreeNode<T>*& r, TwoThreeNode<T>* child)
+        {
+            counters.add(&OpCounters::merges);
+            forgetFamily(p);
+            touchFamily(p);
+
+            if ((p->n == 2) && (p->right == r))
+            {
+                p->middle->k2 = p->k2;
+                p->middle->n = 2;
+                p->middle->right = child;
+
+                child = NULL;
+            }
+            else
+            {
+                if (p->left == r)
+                {
+                    p->middle->k2 = p->middle->k1;
+                    p->middle->k1 = p->k1;
+                    p->middle->n = 2;
+                    p->middle->right = p->middle->middle;
+                    p->middle->middle = p->middle->left;
+                    p->middle->left = child;
+                    child = p->middle;
+                    p->left = p->middle;
+                    p->middle = p->right;
+                }
+                else
+                {
+                    p->left->k2 = p->k1;
+                    p->left->n = 2;
+                    p->left->right = child;
+                    child = p->left;
+                    p->middle = p->right;
+                }
+
+                if (p->n == 2)
+                {
+                    p->k1 = p->k2;
+                    child = NULL;
+                }
+            }
+
+            p->right = NULL;
+            p->n--;
+
+            hoist(r, p);
+            r->left = r->middle = r->right = NULL;
+            freeNode(r);
+            r = NULL;
+
+            return (child);
+        }
+
+        RuntimeInfo<T> _delete(TwoThreeNode<T>* r, T d, TwoThreeNode<T>* p)
+        {
+            if (r != NULL) //empty check
+            {
+                r->dirty = true;
+
+                if (r->left != NULL)
+                {
+                    RuntimeInfo<T> s1(NULL);
+
+                    //d found in an internal node: swap it with its in-order predecessor (always in a leaf),
+                    //then keep descending towards that leaf so every underflow on the way is handled
+                    if ((r->n == 2) && (r->k2 == d))
+                    {
+                        swapWithPredecessor(r, r->k2, r->middle);
+                        s1 = _delete(r->middle, d, r);
+                    }
+                    else if (r->k1 == d)
+                    {
+                        swapWithPredecessor(r, r->k1, r->left);
+                        s1 = _delete(r->left, d, r);
+                    }
+                    else if (d < r->k1)
+                        s1 = _delete(r->left, d, r);
+
+                    else if ((r->n == 1) || (d < r->k2))
+                        s1 = _delete(r->middle, d, r);
+
+                    else
+                        s1 = _delete(r->right, d, r);
+
+                    if (s1.child == NULL)
+                        return s1;
+
+                    if (root->n == 0)
+                    {
+                        if (root->buffer != NULL)   //the new root takes over the buffered operations, a leaf cannot hold them
+                        {
+                            for (auto& op : *root->buffer)
+                            {
+                                if (s1.child->left == NULL) pending.push_back(op);
+                                else put(s1.child, op, true);
+                            }
+
+                            freeBuffer(root->buffer);
+                        }
+
+                        root->left = root->middle = root->right = NULL;
+                        freeNode(root);
+                        root = s1.child;
+                        setHeight(treeHeight - 1);
+
+                        return (NULL);
+                    }
+
+                    ROTATEDIR rd = isRotationPossible(p, r);
+
+                    if (rd == ROTATEDIR::RIGHT)
+                        s1 = rotateRight(p, r, s1.midValue, s1.child);
+
+                    else if (rd == ROTATEDIR::LEFT)
+                        s1 = rotateLeft(p, r, s1.midValue, s1.child);
+
+                    else
+                        s1 = merge(p, r, s1.child); //cant rotate, try merging
+
+                    return s1;
+                }
+                else if ((r->k1 == d) || ((r->n == 2) && (r->k2 == d)))
+                {
+                    if (r->n == 2)
+                    {
+                        if (r->k1 == d)
+                        {
+                            r->k1 = r->k2;
+                        }
+                    }
+
+                    r->n--;
+                }
+
+                if ((r->n == 0) && (p == r))
+                {
+                    freeNode(r);
+                    root = NULL;
+                    setHeight(0);
+                }
+                else if (r->n == 0)
+                {
+
+                    RuntimeInfo<T> s1;
+
+                    ROTATEDIR rd = isRotationPossible(p, r);
+
+
+                    if (rd == ROTATEDIR::RIGHT)
+                        s1 = rotateRight(p, r, s1.midValue, NULL);
+
+                    else if (rd == ROTATEDIR::LEFT)
+                        s1 = rotateLeft(p, r, s1.midValue, NULL);
+
+                    else
+                        s1 = merge(p, r, NULL);
+
+                    return s1;
+                }
+            }
+
+            return (NULL);
+        }
+
+        void swapWithPredecessor(TwoThreeNode<T>* r, T& key, TwoThreeNode<T>* current)
+        {
+            TwoThreeNode<T>* chain = current;
+
+            while (current->left != NULL)
+            {
+                current->dirty = true;
+
+                if (current->n == 1)
+                {
+                    current = current->middle;
+                }
+                else
+                {
+                    current = current->right;
                 }
             }
-            else
+
+            forget(r);
+            forget(current);
+
+            current->dirty = true;
+            T temp = key;
+
+            if (current->n == 1) //2-node
             {
-                if (p->n == 2 && p->right == r) {
-                    p->middle->k2 = p->k2;
+                key = current->k1;
+                current->k1 = temp;
+            }
+            else //3-node
+            {
+                key = current->k2;
+                current->k2 = temp;
+            }
 
-                    if (d < r->k1)
+            //operations on keys in (predecessor, old key] now route right of r's key, move them up into r
+            for (; chain->left != NULL; chain = (chain->n == 1) ? chain->middle : chain->right)
+            {
+                if (chain->buffer == NULL) continue;
+
+                auto& ops = *chain->buffer;
+                for (size_t i = 0; i < ops.size();)
+                {
+                    if ((key < ops[i].key) && !(temp < ops[i].key))
                     {
-                        p->k2 = d;
+                        put(r, ops[i], false);
+                        ops.erase(ops.begin() + i);
                     }
-                    else if (d < r->k2)
+                    else i++;
+                }
+            }
+        }
+
+        TwoThreeNode<T>* search(TwoThreeNode<T>* r, T d)
+        {
+            if (r != NULL)
+            {
+                counters.add(&OpCounters::comparisons, r->n);
+
+                if (r->n == 1)            //root is 2-node
+                {
+                    if (d == r->k1)
+                        return r;
+
+                    else if (d < r->k1)
                     {
-                        p->k2 = r->k1;
-                        r->k1 = d;
+                        return search(r->left, d);
                     }
+
                     else
                     {
-                        p->k2 = r->k1;
-                        r->k1 = r->k2;
-                        r->k2 = d;
+                        return search(r->middle, d);
                     }
-
-                    p->middle->right = p->right->left;
-                    p->right->left = p->right->middle;
-                    p->right->middle = p->right->right;
-                    p->right->right = child;
-                    p->middle->n = 2;
                 }
-
-                else
+                else                        //root is 3-node
                 {
-                    p->left->k2 = p->k1;
+                    if (d == r->k1 || d == r->k2)
+                        return r;
 
-                    if (d < r->k1)
+                    else if (d < r->k1)
                     {
-                        p->k1 = d;
+                        return search(r->left, d);
                     }
+
                     else if (d < r->k2)
                     {
-                        p->k1 = r->k1;
-                        r->k1 = d;
+                        return search(r->middle, d);
                     }
+
                     else
+                        return search(r->right, d);
+                }
+            }
+
+            else
+                return nullptr;       //Not found
+        }
+
+        TwoThreeNode<T>* newNode()
+        {
+            counters.add(&OpCounters::allocations);
+            nodeCount++;
+            return new (resource->allocate(sizeof(TwoThreeNode<T>), alignof(TwoThreeNode<T>))) TwoThreeNode<T>;
+        }
+
+        void freeNode(TwoThreeNode<T>* r)
+        {
+            counters.add(&OpCounters::frees);
+            forget(r);
+            nodeCount--;
+            release(r);
+        }
+
+        //gives back the memory of a node, nodes inside a region only free the region with its last node
+        void release(TwoThreeNode<T>* r)
+        {
+            for (size_t i = 0; i < regions.size(); i++)
+            {
+                NodeRegion<T>& region = regions[i];
+
+                if (r >= region.nodes && r < region.nodes + region.capacity)
+                {
+                    if (--region.live == 0 && (int)i != compactRegion)
                     {
-                        p->k1 = r->k1;
-                        r->k1 = r->k2;
-                        r->k2 = d;
+                        freeRegion(region);
+                        regions.erase(regions.begin() + i);
+                        if (compactRegion > (int)i) compactRegion--;
                     }
 
-                    p->left->right = p->middle->left;
-                    p->middle->left = p->middle->middle;
-                    p->middle->middle = p->middle->right;
-                    p->middle->right = child;
-                    p->left->n = 2;
+                    return;
                 }
             }
 
-            return (NULL);
+            r->~TwoThreeNode<T>();
+            resource->deallocate(r, sizeof(TwoThreeNode<T>), alignof(TwoThreeNode<T>));
         }
 
-        RuntimeInfo<T> insert(TwoThreeNode<T>*& r, T d, TwoThreeNode<T>* p)
+        TwoThreeNode<T>* newRegion(size_t capacity)
         {
-            if (r == nullptr)               //root is empty, insert as root, root becomes a 2-node
+            TwoThreeNode<T>* nodes = (TwoThreeNode<T>*)resource->allocate(capacity * sizeof(TwoThreeNode<T>), alignof(TwoThreeNode<T>));
+
+            for (size_t i = 0; i < capacity; i++)
+                new (nodes + i) TwoThreeNode<T>;
+
+            return nodes;
+        }
+
+        void freeRegion(NodeRegion<T>& region)
+        {
+            for (size_t i = 0; i < region.capacity; i++)
+                region.nodes[i].~TwoThreeNode<T>();
+
+            resource->deallocate(region.nodes, region.capacity * sizeof(TwoThreeNode<T>), alignof(TwoThreeNode<T>));
+        }
+
+        std::pmr::vector<BufferedOp<T>>* newBuffer()
+        {
+            void* p = resource->allocate(sizeof(std::pmr::vector<BufferedOp<T>>), alignof(std::pmr::vector<BufferedOp<T>>));
+            return new (p) std::pmr::vector<BufferedOp<T>>(resource);
+        }
+
+        void freeBuffer(std::pmr::vector<BufferedOp<T>>* b)
+        {
+            if (b == NULL) return;
+
+            b->~vector();
+            resource->deallocate(b, sizeof(std::pmr::vector<BufferedOp<T>>), alignof(std::pmr::vector<BufferedOp<T>>));
+        }
+
+        void freeBloom()
+        {
+            if (bloom == NULL) return;
+
+            bloom->~BlockedBloomFilter();
+            resource->deallocate(bloom, sizeof(BlockedBloomFilter), alignof(BlockedBloomFilter));
+            bloom = NULL;
+        }
+
+        void endCompaction()
+        {
+            if (compactRegion >= 0 && regions[compactRegion].live == 0)
             {
-                TwoThreeNode<T>* temp = new TwoThreeNode<T>;
+                freeRegion(regions[compactRegion]);
+                regions.erase(regions.begin() + compactRegion);
+            }
 
-                temp->k1 = d;
-                temp->left = temp->middle = temp->right = NULL;
+            compactRegion = -1;
+            hasCursor = false;
+        }
 
-                temp->n = 1;
-                r = temp;
+        //lays out the path from the root to the first leaf right of the cursor, false when there is none
+        bool compactStep(size_t& budget)
+        {
+            TwoThreeNode<T>* path[64];                  //a 2-3 tree of 2^64 nodes is not going to happen
+            int index[64];                              //child index taken out of path[i]
+            int depth = 0;
 
-                return (NULL);
+            TwoThreeNode<T>* r = root;
+            while (true)
+            {
+                path[depth] = r;
+                if (r->left == NULL) break;
+
+                if (!hasCursor || cursor < r->k1) index[depth] = 0;
+                else if ((r->n == 1) || (cursor < r->k2)) index[depth] = 1;
+                else index[depth] = 2;
+
+                r = child(r, index[depth++]);
             }
-            else if (r->left == nullptr)  //root is a leaf node
+
+            if (hasCursor && !(cursor < ((r->n == 2) ? r->k2 : r->k1)))    //leaf already done, go to the next one
             {
-                if (r->n == 1)           //root is a 2-node, then make it a 3-node
+                do
                 {
-                    if (d < r->k1)
-                    {
-                        r->k2 = r->k1;
-                        r->k1 = d;
-                    }
+                    if (depth == 0) return false;
+                    depth--;
+                } while (index[depth] == path[depth]->n);
 
-                    else
-                        r->k2 = d;
+                r = child(path[depth], ++index[depth]);
+                depth++;
 
-                    r->n = 2;
+                while (true)
+                {
+                    path[depth] = r;
+                    if (r->left == NULL) break;
 
-                    return (NULL);
+                    index[depth] = 0;
+                    r = r->left;
+                    depth++;
                 }
-                else                        //root is a 3-node
-                {
-                    RuntimeInfo<T> s1;
+            }
 
+            bool moved = false;
 
-                    ROTATEDIR rd = isRotationPossible(p, r);
+            for (int i = 0; i <= depth; i++)
+            {
+                NodeRegion<T>& region = regions[compactRegion];    //release() may drop an older region
 
-                    if (rd == ROTATEDIR::RIGHT)
-                        s1 = rotateRight(p, r, d, NULL);
+                r = path[i];
+                if (r >= region.nodes && r < region.nodes + region.used) continue;
+                if (region.used == region.capacity) return false;
 
-                    else if (rd == ROTATEDIR::LEFT)
-                        s1 = rotateLeft(p, r, d, NULL);
+                TwoThreeNode<T>* slot = &region.nodes[region.used++];
+                *slot = *r;
+                region.live++;
+                forget(r);
+                release(r);
+                moved = true;
 
-                    else
-                        s1 = split3node(r, d, NULL); //cant rotate, try splitting
+                if (i == 0) root = slot;
+                else child(path[i - 1], index[i - 1]) = slot;
 
-                    return s1;
-                }
+                path[i] = slot;
+                if (budget > 0) budget--;
             }
-            else //root is a non-leaf node
-            {
-                if (r->n == 1) //root is a 2-node
-                {
-                    if (d < r->k1)
-                    {
-                        RuntimeInfo<T> s1 = insert(r->left, d, r);
-
-                        if (s1.child != nullptr)
-                        {
-                            r->k2 = r->k1;
-                            r->k1 = s1.midValue;
 
-                            r->right = r->middle;
-                            r->middle = s1.child;
+            if (!moved && budget > 0) budget--;     //a step over an already laid out path still costs something
 
-                            r->n = 2;
-                        }
-                    }
-                    else if (d > r->k1)
-                    {
-                        RuntimeInfo<T> s1 = insert(r->middle, d, r);
+            r = path[depth];
+            cursor = (r->n == 2) ? r->k2 : r->k1;
+            hasCursor = true;
+            return true;
+        }
 
-                        if (s1.child != NULL)
-                        {
-                            r->k2 = s1.midValue;
-                            r->right = s1.child;
-                            r->n = 2;
-                        }
-                    }
+        static TwoThreeNode<T>*& child(TwoThreeNode<T>* r, int i)
+        {
+            return (i == 0) ? r->left : ((i == 1) ? r->middle : r->right);
+        }
 
-                    return (NULL);
-                }
-                else                            //root is a 3-node
-                {
-                    RuntimeInfo<T> s1;
+        template <class Fn>
+        static void range(TwoThreeNode<T>* r, const T& lo, const T& hi, Fn& fn)
+        {
+            if (r == NULL) return;
 
-                    if (d < r->k1)
-                        s1 = insert(r->left, d, r);
-                    else if (d < r->k2)
-                        s1 = insert(r->middle, d, r);
-                    else
-                        s1 = insert(r->right, d, r);
+            if (lo < r->k1) range(r->left, lo, hi, fn);
+            if (!(r->k1 < lo) && !(hi < r->k1)) fn(r->k1);
 
-                    if (s1.child != NULL)
-                    {
-                        ROTATEDIR rd = isRotationPossible(p, r);
+            if (r->k1 < hi && ((r->n == 1) || (lo < r->k2))) range(r->middle, lo, hi, fn);
 
-                        if (rd == ROTATEDIR::RIGHT)
-                            s1 = rotateRight(p, r, s1.midValue, s1.child);
+            if (r->n == 2)
+            {
+                if (!(r->k2 < lo) && !(hi < r->k2)) fn(r->k2);
+                if (r->k2 < hi) range(r->right, lo, hi, fn);
+            }
+        }
 
-                        else if (rd == ROTATEDIR::LEFT)
-                            s1 = rotateLeft(p, r, s1.midValue, s1.child);
+        //keyHash must agree with operator ==, or forget() clears another slot than the one a search for an
+        //equal key probes and a slot outlives its node
+        LookupSlot<T>& cacheSlot(const T& d)
+        {
+            return lookupCache[keyHash(d) & cacheMask];
+        }
 
-                        else
-                            s1 = split3node(r, s1.midValue, s1.child); //cant rotate, try splitting
+        //drops the cached positions of the keys r holds, called before keys leave r or r goes away
+        void forget(TwoThreeNode<T>* r)
+        {
+            if (lookupCache.empty() || r == NULL || r->n == 0) return;
 
-                        return s1;
-                    }
+            LookupSlot<T>& first = cacheSlot(r->k1);
+            if (first.node == r) first.node = NULL;
 
-                    return (NULL);
-                }
+            if (r->n == 2)
+            {
+                LookupSlot<T>& second = cacheSlot(r->k2);
+                if (second.node == r) second.node = NULL;
             }
         }
 
-        RuntimeInfo<T> split3node(TwoThreeNode<T>* current, T k, TwoThreeNode<T>* child)
+        //marks p and its children, the nodes a rotation or merge below p rewrites
+        static void touchFamily(TwoThreeNode<T>* p)
         {
-            T mid;
-            TwoThreeNode<T>* temp = new TwoThreeNode<T>;
-            temp->n = 1;
-            temp->left = temp->middle = temp->right = NULL;
+            p->dirty = true;
+            p->left->dirty = true;
+            p->middle->dirty = true;
+            if (p->n == 2) p->right->dirty = true;
+        }
 
-            if (k < current->k1)
-            {
-                mid = current->k1;
+        //recomputes the hashes and summaries of the dirty nodes under r
+        static uint64_t settle(TwoThreeNode<T>* r)
+        {
+            if (r == NULL) return 0;
+            if (!r->dirty) return r->hash;
 
-                temp->k1 = current->k2;
-                current->k1 = k;
+            uint64_t h = merkleHash(r->k1) + settle(r->left) + settle(r->middle);
+            if (r->n == 2) h += merkleHash(r->k2) + settle(r->right);
 
-                if (current->left != NULL)
+            summarize(*r);
+            r->hash = h;
+            r->dirty = false;
+            return h;
+        }
+
+        //sum of merkleHash over the keys below bound, or up to and including it
+        static uint64_t hashBelow(TwoThreeNode<T>* r, const T& bound, bool inclusive)
+        {
+            uint64_t h = 0;
+
+            while (r != NULL)
+            {
+                if (!(r->k1 < bound) && !(inclusive && r->k1 == bound))
                 {
-                    temp->left = current->middle;
-                    temp->middle = current->right;
-                    current->middle = child;
+                    r = r->left;
+                    continue;
                 }
-            }
-            else if (k < current->k2)
-            {
-                mid = k;
 
-                temp->k1 = current->k2;
+                h += merkleHash(r->k1) + ((r->left != NULL) ? r->left->hash : 0);
 
-                if (current->left != NULL)
+                if (r->n == 1 || (!(r->k2 < bound) && !(inclusive && r->k2 == bound)))
                 {
-                    temp->left = child;
-                    temp->middle = current->right;
+                    r = r->middle;
+                    continue;
                 }
+
+                h += merkleHash(r->k2) + ((r->middle != NULL) ? r->middle->hash : 0);
+                r = r->right;
             }
-            else
-            {
-                mid = current->k2;
 
-                temp->k1 = k;
+            return h;
+        }
 
-                if (current->left != NULL)
-                {
-                    temp->left = current->right;
-                    temp->middle = child;
-                }
+        //hash of the keys strictly between lo and hi, a NULL bound is open
+        uint64_t hashBetween(const T* lo, const T* hi) const
+        {
+            uint64_t h = (root != NULL) ? root->hash : 0;
+
+            if (hi != NULL) h = hashBelow(root, *hi, false);
+            if (lo != NULL) h -= hashBelow(root, *lo, true);
+
+            return h;
+        }
+
+        //calls fn(key) for the keys strictly between lo and hi in ascending order, a NULL bound is open
+        template <class Fn>
+        static void between(TwoThreeNode<T>* r, const T* lo, const T* hi, Fn& fn)
+        {
+            if (r == NULL) return;
+
+            bool k1Above = (lo == NULL) || (*lo < r->k1);
+            bool k1Below = (hi == NULL) || (r->k1 < *hi);
+
+            if (k1Above) between(r->left, lo, hi, fn);
+            if (k1Above && k1Below) fn(r->k1);
+            if (!k1Below) return;
+
+            if (r->n == 1)
+            {
+                between(r->middle, lo, hi, fn);
+                return;
             }
 
-            current->right = NULL;
-            current->n = 1;
+            bool k2Above = (lo == NULL) || (*lo < r->k2);
+            bool k2Below = (hi == NULL) || (r->k2 < *hi);
 
-            RuntimeInfo<T> s1(temp, mid);
-            return s1;
+            if (k2Above) between(r->middle, lo, hi, fn);
+            if (k2Above && k2Below) fn(r->k2);
+            if (k2Below) between(r->right, lo, hi, fn);
         }
 
-        RuntimeInfo<T> merge(TwoThreeNode<T>* p, TwoThreeNode<T>*& r, TwoThreeNode<T>* child)
+        //reports the differences below a, whose keys all lie strictly between lo and hi, against other
+        template <class Fn>
+        void diffNode(TwoThreeNode<T>* a, const T* lo, const T* hi, TwoThreeTree& other, Fn& fn)
         {
-            if ((p->n == 2) && (p->right == r))
-            {
-                p->middle->k2 = p->k2;
-                p->middle->n = 2;
-                p->middle->right = child;
+            uint64_t theirs = other.hashBetween(lo, hi);
+            uint64_t ours = (a != NULL) ? a->hash : 0;
 
-                child = NULL;
-            }
-            else
+            if (ours == theirs) return;
+
+            if (a == NULL || a->left == NULL)       //compare the keys directly
             {
-                if (p->left == r)
-                {
-                    p->middle->k2 = p->middle->k1;
-                    p->middle->k1 = p->k1;
-                    p->middle->n = 2;
-                    p->middle->right = p->middle->middle;
-                    p->middle->middle = p->middle->left;
-                    p->middle->left = child;
-                    child = p->middle;
-                    p->left = p->middle;
-                    p->middle = p->right;
-                }
-                else
-                {
-                    p->left->k2 = p->k1;
-                    p->left->n = 2;
-                    p->left->right = child;
-                    child = p->left;
-                    p->middle = p->right;
-                }
+                std::pmr::vector<T> mine(resource), their(resource);
+                auto collectMine = [&mine](const T& key) { mine.push_back(key); };
+                auto collectTheirs = [&their](const T& key) { their.push_back(key); };
 
-                if (p->n == 2)
+                between(a, lo, hi, collectMine);
+                between(other.root, lo, hi, collectTheirs);
+
+                size_t i = 0, j = 0;
+                while (i < mine.size() || j < their.size())
                 {
-                    p->k1 = p->k2;
-                    child = NULL;
+                    if (j == their.size() || (i < mine.size() && mine[i] < their[j])) fn(mine[i++], true);
+                    else if (i == mine.size() || their[j] < mine[i]) fn(their[j++], false);
+                    else
+                    {
+                        if (merkleHash(mine[i]) != merkleHash(their[j]))
+                        {
+                            fn(mine[i], true);
+                            fn(their[j], false);
+                        }
+
+                        i++;
+                        j++;
+                    }
                 }
+
+                return;
             }
 
-            p->right = NULL;
-            p->n--;
+            differs(a->k1, other, fn);
+            diffNode(a->left, lo, &a->k1, other, fn);
 
-            r->left = r->middle = r->right = NULL;
-            delete r;
-            r = NULL;
+            if (a->n == 1)
+            {
+                diffNode(a->middle, &a->k1, hi, other, fn);
+                return;
+            }
 
-            return (child);
+            diffNode(a->middle, &a->k1, &a->k2, other, fn);
+            differs(a->k2, other, fn);
+            diffNode(a->right, &a->k2, hi, other, fn);
         }
 
-        RuntimeInfo<T> _delete(TwoThreeNode<T>* r, T d, TwoThreeNode<T>* p)
+        //reports a separator key of this tree that other lacks or holds with another merkleHash
+        template <class Fn>
+        static void differs(const T& key, TwoThreeTree& other, Fn& fn)
         {
-            if (r != NULL) //empty check
+            TwoThreeNode<T>* o = other.search(other.root, key);
+
+            if (o == nullptr)
             {
-                if (r->left != NULL)
-                {
-                    RuntimeInfo<T> s1(NULL);
+                fn(key, true);
+                return;
+            }
 
-                    if (r->n == 1) //2-node
-                    {
-                        if (d != r->k1)
-                        {
-                            if (d < r->k1)
-                            {
-                                s1 = _delete(r->left, d, r);
-                            }
+            const T& theirs = (o->k1 == key) ? o->k1 : o->k2;
 
-                            else
-                                s1 = _delete(r->middle, d, r);
+            if (merkleHash(theirs) != merkleHash(key))
+            {
+                fn(key, true);
+                fn(theirs, false);
+            }
+        }
 
-                            if (s1.child == NULL)
-                                return s1;
-                        }
-                    }
-                    else //3-node
-                    {
-                        if ((d != r->k1) && (d != r->k2))
-                        {
-                            if (d < r->k1)
-                            {
-                                s1 = _delete(r->left, d, r);
-                            }
+        //p and its children, the nodes a rotation or merge below p moves keys between
+        void forgetFamily(TwoThreeNode<T>* p)
+        {
+            if (lookupCache.empty()) return;
 
-                            else if (d < r->k2)
-                            {
-                                s1 = _delete(r->middle, d, r);
-                            }
+            forget(p);
+            forget(p->left);
+            forget(p->middle);
+            if (p->n == 2) forget(p->right);
+        }
 
-                            else
-                                s1 = _delete(r->right, d, r);
+        void resetBloom(size_t keys)
+        {
+            bloom->reset((std::max)(2 * keys, (size_t)1024));
+            bloomKeys = keys;
+            bloomDeletes = 0;
+        }
 
-                            if (s1.child == NULL)
-                                return s1;
-                        }
-                    }
+        //refills the filter from the tree, buffered operations are applied first
+        void rebuildBloom()
+        {
+            size_t keys = 0;
+            forEach([&keys](const T&) { keys++; });
 
-                    if (root->n == 0)
-                    {
-                        root->left = root->middle = root->right = NULL;
-                        delete root;
-                        root = s1.child;
+            auto add = [this](const T& key) { bloom->add(keyHash(key)); };
+            resetBloom(keys);
+            inorder(root, add);
+        }
 
-                        r = root;
+        void bloomInsert(const T& d)
+        {
+            if (bloom == NULL) return;
 
-                        return (NULL);
-                    }
+            if (++bloomKeys > bloom->capacity()) rebuildBloom();
+            else bloom->add(keyHash(d));
+        }
 
+        void bloomDelete(size_t count = 1)
+        {
+            if (bloom == NULL || count == 0) return;
 
-                    if (s1.child != NULL)
-                    {
-                        ROTATEDIR rd = isRotationPossible(p, r);
+            bloomDeletes += count;
+            if (4 * bloomDeletes > bloomKeys) rebuildBloom();
+        }
 
-                        if (rd == ROTATEDIR::RIGHT)
-                            s1 = rotateRight(p, r, s1.midValue, s1.child);
+        template <class Fn>
+        static void inorder(TwoThreeNode<T>* r, Fn& fn)
+        {
+            if (r == NULL) return;
 
-                        else if (rd == ROTATEDIR::LEFT)
-                            s1 = rotateLeft(p, r, s1.midValue, s1.child);
+            inorder(r->left, fn);
+            fn(r->k1);
+            inorder(r->middle, fn);
 
-                        else
-                            s1 = merge(p, r, s1.child); //cant rotate, try merging
+            if (r->n == 2)
+            {
+                fn(r->k2);
+                inorder(r->right, fn);
+            }
+        }
 
-                        return s1;
-                    }
+        //child of r whose subtree buffers operations on d, a key equal to a separator goes left of it
+        static TwoThreeNode<T>* route(TwoThreeNode<T>* r, const T& d)
+        {
+            if (!(r->k1 < d)) return r->left;
+            if ((r->n == 1) || !(r->k2 < d)) return r->middle;
+            return r->right;
+        }
 
-                    TwoThreeNode<T>* current;
-                    T temp;
+        //walks the path of d, the highest buffered operation on d is the newest one and wins over the keys.
+        //a buffered insert of a key no node above it holds yet is applied first, so the node returned holds d
+        TwoThreeNode<T>* searchBuffered(T d)
+        {
+            TwoThreeNode<T>* found = nullptr;
 
-                    if ((r->n == 2) && (r->k2 == d))
-                    {
-                        temp = r->k2;
-                        current = r->middle;
+            for (TwoThreeNode<T>* r = root; r != NULL; r = route(r, d))
+            {
+                if (r->buffer != NULL)
+                {
+                    for (auto& op : *r->buffer)
+                        if (op.key == d) return op.erase ? nullptr : (found != nullptr ? found : materialize(op.key));
+                }
 
-                        p = r;
+                if ((found == nullptr) && ((d == r->k1) || ((r->n == 2) && (d == r->k2))))
+                    found = r;
+            }
 
-                        while (current->left != NULL)
-                        {
-                            p = current;
+            return found;
+        }
 
-                            if (current->n == 1)
-                            {
-                                current = current->middle;
-                            }
+        //drops every buffered operation on d, which all sit on its path, and inserts d into the tree. d is a
+        //copy of the buffered key, which carries the payload (a count, a tombstone flag) the probe lacks
+        TwoThreeNode<T>* materialize(T d)
+        {
+            for (TwoThreeNode<T>* r = root; r != NULL; r = route(r, d))
+            {
+                if (r->buffer == NULL) continue;
 
-                            else
-                            {
-                                current = current->right;
-                            }
-                        }
+                auto same = [&d](const BufferedOp<T>& op) { return op.key == d; };
+                r->buffer->erase(std::remove_if(r->buffer->begin(), r->buffer->end(), same), r->buffer->end());
+            }
 
+            _insert(d);
+            return search(root, d);
+        }
 
-                        if (current->n == 1) //2-node
-                        {
-                            r->k2 = current->k1;
-                            current->k1 = temp;
-                        }
+        //adds op to r's buffer; an operation already buffered on the same key is replaced only if op is newer
+        void put(TwoThreeNode<T>* r, const BufferedOp<T>& op, bool newer)
+        {
+            if (r->buffer == NULL) r->buffer = newBuffer();
 
-                        else //3-node
-                        {
-                            r->k2 = current->k2;
-                            current->k2 = temp;
-                        }
-                    }
+            for (auto& old : *r->buffer)
+            {
+                if (old.key == op.key)
+                {
+                    if (newer) old = op;
+                    return;
+                }
+            }
 
+            r->buffer->push_back(op);
+        }
 
-                    else
-                    {
-                        temp = r->k1;
-                        current = r->left;
+        //moves the operations buffered at from into its ancestor to, which is on the path of all their keys
+        void hoist(TwoThreeNode<T>* from, TwoThreeNode<T>* to)
+        {
+            if (from == NULL || from->buffer == NULL) return;
 
-                        p = r;
+            for (auto& op : *from->buffer)
+                put(to, op, false);
 
-                        while (current->left != NULL)
-                        {
-                            p = current;
+            freeBuffer(from->buffer);
+            from->buffer = NULL;
+        }
 
-                            if (current->n == 1)
-                            {
-                                current = current->middle;
-                            }
-                            else
-                            {
-                                current = current->right;
-                            }
-                        }
+        //a rotation moves keys between p and its children, their buffers go up into p
+        void hoistChildren(TwoThreeNode<T>* p)
+        {
+            hoist(p->left, p);
+            hoist(p->middle, p);
+            if (p->n == 2) hoist(p->right, p);
+        }
 
+        void enqueue(const BufferedOp<T>& op)
+        {
+            if (bufferCapacity == 0 || root == NULL || root->left == NULL)  //nowhere to buffer, apply right away
+            {
+                pending.push_back(op);
+                applyPending();
+                return;
+            }
 
-                        if (current->n == 1)
-                        {
-                            r->k1 = current->k1;
-                            current->k1 = temp;
-                        }
+            put(root, op, true);
 
-                        else if (current->n == 2)
-                        {
-                            r->k1 = current->k2;
-                            current->k2 = temp;
-                        }
-                    }
+            if (root->buffer->size() > bufferCapacity)
+            {
+                flush(root);
+                applyPending();
+            }
+        }
 
-                    current->n--;
-                    r = current;
-                }
-                else if ((r->left == NULL) && ((r->k1 == d) || (r->k2 == d)))
-                {
-                    if (r->n == 2)
-                    {
-                        if (r->k1 == d)
-                        {
-                            r->k1 = r->k2;
-                        }
-                    }
+        //pushes r's buffer one level down, children that overflow are flushed in turn
+        void flush(TwoThreeNode<T>* r)
+        {
+            for (auto& op : *r->buffer)
+            {
+                TwoThreeNode<T>* c = route(r, op.key);
 
-                    r->n--;
-                }
+                if (c->left == NULL) pending.push_back(op);     //c is a leaf, op is ready to be applied
+                else put(c, op, true);
+            }
 
-                if ((r->n == 0) && (p == r))
-                {
-                    delete r;
-                    root = NULL;
-                }
-                else if (r->n == 0)
-                {
+            r->buffer->clear();
 
-                    RuntimeInfo<T> s1;
+            TwoThreeNode<T>* children[3] = { r->left, r->middle, (r->n == 2) ? r->right : NULL };
+            for (auto c : children)
+            {
+                if (c != NULL && c->buffer != NULL && c->buffer->size() > bufferCapacity)
+                    flush(c);
+            }
+        }
 
-                    ROTATEDIR rd = isRotationPossible(p, r);
+        //applies pending operations in key order so consecutive ones share most of their path
+        void applyPending()
+        {
+            std::stable_sort(pending.begin(), pending.end(), [](const BufferedOp<T>& a, const BufferedOp<T>& b) { return a.key < b.key; });
 
+            for (size_t i = 0; i < pending.size(); i++)     //a root collapse may append more
+            {
+                BufferedOp<T> op = pending[i];
 
-                    if (rd == ROTATEDIR::RIGHT)
-                        s1 = rotateRight(p, r, s1.midValue, NULL);
+                if (op.erase) _erase(op.key);
+                else _insert(op.key);
+            }
 
-                    else if (rd == ROTATEDIR::LEFT)
-                        s1 = rotateLeft(p, r, s1.midValue, NULL);
+            pending.clear();
+        }
 
-                    else
-                        s1 = merge(p, r, NULL);
+        //takes every buffered operation out of the subtree, parents before children
+        void collectBuffers(TwoThreeNode<T>* r, std::pmr::vector<BufferedOp<T>>& ops)
+        {
+            if (r == NULL || r->left == NULL) return;
 
-                    return s1;
-                }
+            if (r->buffer != NULL)
+            {
+                ops.insert(ops.end(), r->buffer->begin(), r->buffer->end());
+                freeBuffer(r->buffer);
+                r->buffer = NULL;
             }
 
-            return (NULL);
+            collectBuffers(r->left, ops);
+            collectBuffers(r->middle, ops);
+            if (r->n == 2) collectBuffers(r->right, ops);
         }
 
-        TwoThreeNode<T>* search(TwoThreeNode<T>* r, T d)
+        //runs fn(lo, hi) over [0, n) split into one contiguous chunk per thread
+        template <class Fn>
+        static void parallelFor(size_t n, unsigned threads, Fn fn)
         {
-            if (r != NULL)
+            size_t chunks = (std::min<size_t>)(threads, n);
+
+            if (chunks <= 1)
             {
-                if (r->n == 1)            //root is 2-node
+                fn(0, n);
+                return;
+            }
+
+            std::vector<std::thread> workers;
+            for (size_t c = 0; c < chunks; c++)
+                workers.emplace_back(fn, n * c / chunks, n * (c + 1) / chunks);
+
+            for (auto& w : workers) w.join();
+        }
+
+        static void parallelSort(std::pmr::vector<T>& keys, unsigned threads)
+        {
+            size_t chunks = (std::min<size_t>)(threads, keys.size() / 1024 + 1);
+            std::pmr::vector<size_t> bounds(chunks + 1, keys.get_allocator().resource());
+
+            for (size_t c = 0; c <= chunks; c++)
+                bounds[c] = keys.size() * c / chunks;
+
+            parallelFor(chunks, threads, [&](size_t lo, size_t hi)
                 {
-                    if (d == r->k1)
-                        return r;
+                    for (size_t c = lo; c < hi; c++)
+                        std::sort(keys.begin() + bounds[c], keys.begin() + bounds[c + 1]);
+                });
 
-                    else if (d < r->k1)
-                    {
-                        return search(r->left, d);
-                    }
+            //merge sorted runs pairwise, every round halves the number of runs
+            for (size_t width = 1; width < chunks; width *= 2)
+            {
+                size_t pairs = (chunks + 2 * width - 1) / (2 * width);
 
-                    else
+                parallelFor(pairs, threads, [&](size_t lo, size_t hi)
                     {
-                        return search(r->middle, d);
-                    }
-                }
-                else                        //root is 3-node
+                        for (size_t i = lo; i < hi; i++)
+                        {
+                            size_t first = 2 * width * i;
+                            size_t middle = (std::min)(first + width, chunks);
+                            size_t last = (std::min)(first + 2 * width, chunks);
+
+                            std::inplace_merge(keys.begin() + bounds[first], keys.begin() + bounds[middle], keys.begin() + bounds[last]);
+                        }
+                    });
+            }
+        }
+
+        static void parallelUnique(std::pmr::vector<T>& keys, unsigned threads)
+        {
+            size_t n = keys.size();
+            size_t chunks = (std::min<size_t>)(threads, n / 1024 + 1);
+            std::pmr::vector<size_t> kept(chunks + 1, 0, keys.get_allocator().resource());     //prefix sums of the keys kept by every chunk
+
+            parallelFor(chunks, threads, [&](size_t lo, size_t hi)
                 {
-                    if (d == r->k1 || d == r->k2)
-                        return r;
+                    for (size_t c = lo; c < hi; c++)
+                        for (size_t i = n * c / chunks; i < n * (c + 1) / chunks; i++)
+                            if (i == 0 || !(keys[i] == keys[i - 1])) kept[c + 1]++;
+                });
 
-                    else if (d < r->k1)
-                    {
-                        return search(r->left, d);
-                    }
+            for (size_t c = 0; c < chunks; c++)
+                kept[c + 1] += kept[c];
 
-                    else if (d < r->k2)
+            std::pmr::vector<T> out(kept[chunks], keys.get_allocator().resource());
+
+            parallelFor(chunks, threads, [&](size_t lo, size_t hi)
+                {
+                    for (size_t c = lo; c < hi; c++)
                     {
-                        return search(r->middle, d);
+                        size_t pos = kept[c];
+                        for (size_t i = n * c / chunks; i < n * (c + 1) / chunks; i++)
+                            if (i == 0 || !(keys[i] == keys[i - 1])) out[pos++] = keys[i];
                     }
+                });
 
-                    else
-                        return search(r->right, d);
-                }
-            }
-
-            else
-                return nullptr;       //Not found
+            keys.swap(out);
         }
 
 #ifdef _DEBUG
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+
+namespace ds
+{
+    enum class KeyPattern
+    {
+        UNIFORM = 0,
+        ZIPF,                                   //a few keys take most of the ops
+        ASCENDING,
+        DESCENDING,
+        SAWTOOTH,                               //ascending sweeps over the key space, each shifted by one
+        CLUSTERED,                              //bursts of keys around one random point
+        ROTATION_ADVERSARY,                     //deletes picked so no sibling can lend a key, every one merges
+        CASCADE_ADVERSARY                       //inserts also picked to split every node up to the root
+    };
+
+    const char* const KEY_PATTERN_NAMES[] = { "uniform", "zipf", "ascending", "descending", "sawtooth", "clustered", "rotation-adversary", "cascade-adversary" };
+    const int KEY_PATTERN_COUNT = 8;
+
+    enum class WorkloadOpKind : uint8_t
+    {
+        INSERT = 0,
+        REMOVE,                                 //not DELETE, which Windows.h defines as a macro
+        SEARCH
+    };
+
+    struct WorkloadOp
+    {
+        WorkloadOpKind kind;
+        int64_t key;
+    };
+
+    struct WorkloadConfig
+    {
+        KeyPattern pattern{ KeyPattern::UNIFORM };
+        uint64_t seed{ 1 };
+        int64_t keySpace{ 1 << 20 };            //keys are drawn from [0, keySpace)
+        unsigned insertPercent{ 50 };           //the rest after inserts and deletes are searches
+        unsigned deletePercent{ 0 };
+        double zipfSkew{ 0.99 };
+        bool zipfScramble{ true };              //spread the hot ranks over the key space instead of its low end
+        size_t sawtoothPeriod{ 1024 };          //keys per sweep
+        size_t burstLength{ 64 };               //keys per cluster
+        int64_t burstWidth{ 256 };              //span of a cluster
+    };
+
+    //splitmix64, small and the same on every platform, unlike the std distributions
+    class WorkloadRandom
+    {
+    public:
+        explicit WorkloadRandom(uint64_t seed = 1) : state(seed) {}
+
+        uint64_t next()
+        {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        //uniform in [0, n), n > 0
+        uint64_t below(uint64_t n)
+        {
+            uint64_t limit = UINT64_MAX - UINT64_MAX % n;
+            uint64_t x;
+            do x = next(); while (x >= limit);
+            return x % n;
+        }
+
+        //uniform in [0, 1)
+        double unit()
+        {
+            return (next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    //Zipf distributed ranks in [1, n] with P(k) proportional to k^-s, by rejection-inversion (Hoermann and
+    //Derflinger), O(1) per sample with no table, so it works for any n
+    class ZipfSampler
+    {
+    public:
+        ZipfSampler(uint64_t n = 1, double s = 0.99) : n(n), s(s)
+        {
+            hX1 = hIntegral(1.5) - 1.0;
+            hN = hIntegral((double)n + 0.5);
+            sDiv = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+        }
+
+        uint64_t sample(WorkloadRandom& rng) const
+        {
+            for (;;)
+            {
+                double u = hN + rng.unit() * (hX1 - hN);
+                double x = hIntegralInverse(u);
+                double k = std::floor(x + 0.5);
+
+                if (k < 1) k = 1;
+                else if (k > (double)n) k = (double)n;
+
+                if (k - x <= sDiv || u >= hIntegral(k + 0.5) - h(k)) return (uint64_t)k;
+            }
+        }
+
+    private:
+        double h(double x) const { return std::exp(-s * std::log(x)); }
+
+        double hIntegral(double x) const
+        {
+            double logX = std::log(x);
+            return helper2((1.0 - s) * logX) * logX;
+        }
+
+        double hIntegralInverse(double x) const
+        {
+            double t = x * (1.0 - s);
+            if (t < -1.0) t = -1.0;
+            return std::exp(helper1(t) * x);
+        }
+
+        //log1p(x) / x and expm1(x) / x, continued to x = 0
+        static double helper1(double x) { return (std::fabs(x) > 1e-8) ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)); }
+        static double helper2(double x) { return (std::fabs(x) > 1e-8) ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x)); }
+
+    private:
+        uint64_t n;
+        double s;
+        double hX1, hN, sDiv;
+    };
+
+    //deterministic stream of insert/delete/search ops: the same config gives the same ops on every run, and on
+    //every platform for all patterns but ZIPF, which goes through the libm exp and log. the adversarial patterns keep a shadow TwoThreeTree of the keys the stream has inserted and walk
+    //it to pick each key, so they stay aimed at the current shape of any tree fed the same stream from the
+    //same start (empty, or preload()). inserts go down the path with the most 3-nodes, where every node
+    //splits; deletes go down 2-nodes whose siblings are 2-nodes, where isRotationPossible fails and the
+    //merge repeats on the parent
+    class Workload
+    {
+    public:
+        explicit Workload(const WorkloadConfig& config = WorkloadConfig())
+        {
+            reset(config);
+        }
+
+        Workload(const Workload&) = delete;
+        Workload& operator=(const Workload&) = delete;
+
+        //restarts the stream
+        void reset(const WorkloadConfig& c)
+        {
+            config = c;
+            if (config.keySpace < 1) config.keySpace = 1;
+
+            rng = WorkloadRandom(config.seed);
+            zipf = ZipfSampler((uint64_t)config.keySpace, config.zipfSkew);
+            issued = 0;
+            burstLeft = 0;
+            burstBase = 0;
+
+            scrambleBits = 1;
+            while (scrambleBits < 63 && ((int64_t)1 << scrambleBits) < config.keySpace) scrambleBits++;
+
+            if (isAdversarial()) shadow.reset(new TwoThreeTree<int64_t>());
+            else shadow.reset();
+        }
+
+        void reset()
+        {
+            reset(config);
+        }
+
+        //count distinct uniform keys in the order they should be inserted before the stream starts.
+        //count is capped at the key space
+        std::vector<int64_t> preload(size_t count)
+        {
+            if ((int64_t)count > config.keySpace) count = (size_t)config.keySpace;
+
+            //a random permutation of the key space, so the first count keys are distinct without a lookup
+            WorkloadRandom pick(config.seed ^ 0x5851f42d4c957f2dull);
+            uint64_t mask = ((uint64_t)1 << scrambleBits) - 1;
+            uint64_t offset = pick.next() & mask;
+            uint64_t multiplier = pick.next() | 1;
+
+            std::vector<int64_t> keys;
+            keys.reserve(count);
+
+            for (uint64_t i = 0; keys.size() < count; i++)
+            {
+                int64_t k = permute((i + offset) & mask, multiplier);
+                if (k < config.keySpace) keys.push_back(k);
+            }
+
+            if (shadow) for (int64_t k : keys) shadow->insert(k);
+            return keys;
+        }
+
+        WorkloadOp next()
+        {
+            WorkloadOp op;
+            uint64_t roll = rng.below(100);
+
+            if (roll < config.insertPercent) op.kind = WorkloadOpKind::INSERT;
+            else if (roll < (uint64_t)config.insertPercent + config.deletePercent) op.kind = WorkloadOpKind::REMOVE;
+            else op.kind = WorkloadOpKind::SEARCH;
+
+            if (shadow)
+            {
+                if (shadow->root == NULL && op.kind == WorkloadOpKind::REMOVE) op.kind = WorkloadOpKind::INSERT;
+
+                if (op.kind == WorkloadOpKind::INSERT) op.key = (config.pattern == KeyPattern::CASCADE_ADVERSARY) ? splitTarget() : nextKey();
+                else if (op.kind == WorkloadOpKind::REMOVE) op.key = mergeTarget();
+                else op.key = nextKey();
+
+                if (op.kind == WorkloadOpKind::INSERT) shadow->insert(op.key);
+                else if (op.kind == WorkloadOpKind::REMOVE) shadow->deleteNode(op.key);
+            }
+            else op.key = nextKey();
+
+            issued++;
+            return op;
+        }
+
+        void fill(std::vector<WorkloadOp>& out, size_t count)
+        {
+            out.reserve(out.size() + count);
+            for (size_t i = 0; i < count; i++) out.push_back(next());
+        }
+
+        //next key of the pattern alone, uniform for the adversarial ones
+        int64_t nextKey()
+        {
+            int64_t space = config.keySpace;
+            uint64_t i = issued;
+
+            switch (config.pattern)
+            {
+            case KeyPattern::ZIPF:
+            {
+                int64_t rank = (int64_t)zipf.sample(rng) - 1;
+                if (!config.zipfScramble) return rank;
+
+                //cycle-walk a bijection of the enclosing power of two until it lands in the key space
+                do rank = permute((uint64_t)rank, 0x9e3779b97f4a7c15ull); while (rank >= space);
+                return rank;
+            }
+
+            case KeyPattern::ASCENDING:
+                return (int64_t)(i % (uint64_t)space);
+
+            case KeyPattern::DESCENDING:
+                return space - 1 - (int64_t)(i % (uint64_t)space);
+
+            case KeyPattern::SAWTOOTH:
+            {
+                uint64_t period = (config.sawtoothPeriod > 0) ? config.sawtoothPeriod : 1;
+                uint64_t stride = (std::max)((uint64_t)space / period, (uint64_t)1);
+                return (int64_t)(((i % period) * stride + i / period) % (uint64_t)space);
+            }
+
+            case KeyPattern::CLUSTERED:
+            {
+                int64_t width = (std::min)((std::max)(config.burstWidth, (int64_t)1), space);
+
+                if (burstLeft == 0)
+                {
+                    burstBase = (int64_t)rng.below((uint64_t)(space - width + 1));
+                    burstLeft = (std::max)(config.burstLength, (size_t)1);
+                }
+
+                burstLeft--;
+                return burstBase + (int64_t)rng.below((uint64_t)width);
+            }
+
+            default:
+                return (int64_t)rng.below((uint64_t)space);
+            }
+        }
+
+        const WorkloadConfig& getConfig() const
+        {
+            return config;
+        }
+
+        //keys the adversarial patterns believe are present, NULL for the others
+        const TwoThreeTree<int64_t>* getShadow() const
+        {
+            return shadow.get();
+        }
+
+        static const char* patternName(KeyPattern p)
+        {
+            return KEY_PATTERN_NAMES[(int)p];
+        }
+
+        //pattern by name, false if there is no such pattern
+        static bool parsePattern(const char* name, KeyPattern& p)
+        {
+            for (int i = 0; i < KEY_PATTERN_COUNT; i++)
+            {
+                if (std::string_view(name) == KEY_PATTERN_NAMES[i])
+                {
+                    p = (KeyPattern)i;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        bool isAdversarial() const
+        {
+            return config.pattern == KeyPattern::ROTATION_ADVERSARY || config.pattern == KeyPattern::CASCADE_ADVERSARY;
+        }
+
+        //bijection of [0, 2^scrambleBits): odd multipliers and right xorshifts are both invertible mod 2^bits
+        int64_t permute(uint64_t x, uint64_t multiplier) const
+        {
+            uint64_t mask = ((uint64_t)1 << scrambleBits) - 1;
+            unsigned shift = (scrambleBits + 1) / 2;
+
+            x = (x * (multiplier | 1)) & mask;
+            x ^= x >> shift;
+            x = (x * 0xbf58476d1ce4e5b9ull) & mask;
+            x ^= x >> shift;
+            return (int64_t)x;
+        }
+
+        //absent key whose insertion lands in a leaf below the longest run of 3-nodes
+        int64_t splitTarget()
+        {
+            TwoThreeNode<int64_t>* r = shadow->root;
+            if (r == NULL) return nextKey();
+
+            while (r->left != NULL)
+            {
+                TwoThreeNode<int64_t>* children[3] = { r->left, r->middle, r->right };
+                int count = r->n + 1;
+
+                //the 3-node children, one of them at random
+                int full[3], fullCount = 0;
+                for (int i = 0; i < count; i++)
+                    if (children[i]->n == 2) full[fullCount++] = i;
+
+                r = (fullCount > 0) ? children[full[rng.below(fullCount)]] : children[rng.below(count)];
+            }
+
+            //a key next to the leaf's own keys belongs to the same leaf unless an ancestor already holds it
+            int64_t candidates[3] = { r->k1 - 1, r->k1 + 1, (r->n == 2) ? r->k2 + 1 : r->k1 + 1 };
+            for (int64_t k : candidates)
+                if (k >= 0 && k < config.keySpace && shadow->searchFor(k) == NULL) return k;
+
+            return nextKey();
+        }
+
+        //present key in a leaf 2-node on the longest path of 2-nodes with 2-node siblings
+        int64_t mergeTarget()
+        {
+            TwoThreeNode<int64_t>* r = shadow->root;
+
+            while (r->left != NULL)
+            {
+                TwoThreeNode<int64_t>* children[3] = { r->left, r->middle, r->right };
+                int count = r->n + 1;
+
+                //a 2-node child whose neighbours are 2-nodes as well cannot borrow a key
+                int best[3], bestCount = 0, thin[3], thinCount = 0;
+
+                for (int i = 0; i < count; i++)
+                {
+                    if (children[i]->n != 1) continue;
+                    thin[thinCount++] = i;
+
+                    bool lender = (i > 0 && children[i - 1]->n == 2) || (i + 1 < count && children[i + 1]->n == 2);
+                    if (!lender) best[bestCount++] = i;
+                }
+
+                if (bestCount > 0) r = children[best[rng.below(bestCount)]];
+                else if (thinCount > 0) r = children[thin[rng.below(thinCount)]];
+                else r = children[rng.below(count)];
+            }
+
+            return r->k1;
+        }
+
+    private:
+        WorkloadConfig config;
+        WorkloadRandom rng;
+        ZipfSampler zipf;
+        uint64_t issued{ 0 };
+        size_t burstLeft{ 0 };
+        int64_t burstBase{ 0 };
+        unsigned scrambleBits{ 1 };
+        std::unique_ptr<TwoThreeTree<int64_t>> shadow;  //only for the adversarial patterns
+    };
+}
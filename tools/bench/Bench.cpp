@@ -0,0 +1,447 @@
+//headless benchmark of ds::TwoThreeTree<int> against std::set<int> and a sorted std::vector<int>,
+//no ImGui or GLFW involved. every structure runs the same key streams at each size and one row per
+//(structure, workload, size) is written as CSV or JSON
+//
+//  Bench [--sizes 1e3,1e4,1e5,1e6] [--structures tree,set,vector] [--format csv|json] [--out file]
+//        [--ops n] [--seed n] [--patterns zipf,clustered,...]
+//
+//--patterns adds a "mix-<pattern>" row per named ds::Workload key pattern: n preloaded keys, then a stream of
+//half searches, a quarter inserts and a quarter deletes drawn from the pattern
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+#include "TwoThreeTree.hpp"
+#include "Workload.hpp"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t SAMPLE_EVERY = 16;             //one op in SAMPLE_EVERY is timed on its own for the percentiles
+    const int RANGE_WIDTH = 200;                //a range scan covers about 100 keys, keys are two apart
+    const size_t VECTOR_LIMIT = 100000;         //single-key inserts and deletes into a vector are O(n), skipped above this
+
+    struct Options
+    {
+        std::vector<size_t> sizes{ 1000, 10000, 100000, 1000000 };
+        std::vector<std::string> structures{ "tree", "set", "vector" };
+        std::string format{ "csv" };
+        std::string out;
+        size_t ops{ 1000000 };                  //lookups and scans per workload, capped by the key count for updates
+        uint64_t seed{ 42 };
+        std::vector<ds::KeyPattern> patterns;
+    };
+
+    struct Row
+    {
+        std::string structure;
+        std::string workload;
+        size_t keys;
+        size_t ops;
+        double nsPerOp;
+        double p50;
+        double p99;
+        size_t rss;
+        double bytesPerKey;                     //RSS growth while the keys were inserted, over the key count
+        double heapPerKey;                      //the structure's own accounting of its memory, over the key count
+    };
+
+    size_t residentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+        return pmc.WorkingSetSize;
+#else
+        std::ifstream statm("/proc/self/statm");
+        size_t total = 0, resident = 0;
+        if (!(statm >> total >> resident)) return 0;
+        return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    //times op(i) for i in [0, n), every SAMPLE_EVERY-th call separately
+    template <class Op>
+    void measure(Row& row, size_t n, Op op)
+    {
+        std::vector<double> samples;
+        samples.reserve(n / SAMPLE_EVERY + 1);
+
+        Clock::time_point start = Clock::now();
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (i % SAMPLE_EVERY == 0)
+            {
+                Clock::time_point t = Clock::now();
+                op(i);
+                samples.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count());
+            }
+            else op(i);
+        }
+
+        double total = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        row.ops = n;
+        row.nsPerOp = (n > 0) ? total / n : 0;
+
+        if (!samples.empty())
+        {
+            std::sort(samples.begin(), samples.end());
+            row.p50 = samples[samples.size() / 2];
+            row.p99 = samples[(std::min)(samples.size() - 1, samples.size() * 99 / 100)];
+        }
+    }
+
+    //the three structures behind one interface, so every workload is written once
+    struct TreeSubject
+    {
+        ds::TwoThreeTree<int> tree;
+
+        void insert(int k) { tree.insert(k); }
+        void erase(int k) { tree.deleteNode(k); }
+        bool find(int k) { return tree.searchFor(k) != nullptr; }
+
+        size_t scan(int lo, int hi)
+        {
+            size_t n = 0;
+            tree.forRange(lo, hi, [&n](int) { n++; });
+            return n;
+        }
+
+        void bulk(const std::vector<int>& keys) { tree.buildParallel(keys.begin(), keys.end()); }
+        size_t bytes() { return tree.stats().bytes; }
+    };
+
+    struct SetSubject
+    {
+        std::set<int> set;
+
+        void insert(int k) { set.insert(k); }
+        void erase(int k) { set.erase(k); }
+        bool find(int k) { return set.find(k) != set.end(); }
+
+        size_t scan(int lo, int hi)
+        {
+            size_t n = 0;
+            for (auto it = set.lower_bound(lo); it != set.end() && *it <= hi; ++it) n++;
+            return n;
+        }
+
+        void bulk(const std::vector<int>& keys) { set.insert(keys.begin(), keys.end()); }
+
+        //red-black node: three links, the colour and the key, padded to pointer alignment
+        size_t bytes() { return set.size() * (4 * sizeof(void*) + ((sizeof(int) + sizeof(void*) - 1) / sizeof(void*)) * sizeof(void*)); }
+    };
+
+    struct VectorSubject
+    {
+        std::vector<int> keys;
+
+        void insert(int k)
+        {
+            auto it = std::lower_bound(keys.begin(), keys.end(), k);
+            if (it == keys.end() || *it != k) keys.insert(it, k);
+        }
+
+        void erase(int k)
+        {
+            auto it = std::lower_bound(keys.begin(), keys.end(), k);
+            if (it != keys.end() && *it == k) keys.erase(it);
+        }
+
+        bool find(int k) { return std::binary_search(keys.begin(), keys.end(), k); }
+
+        size_t scan(int lo, int hi)
+        {
+            size_t n = 0;
+            for (auto it = std::lower_bound(keys.begin(), keys.end(), lo); it != keys.end() && *it <= hi; ++it) n++;
+            return n;
+        }
+
+        void bulk(const std::vector<int>& sorted)
+        {
+            keys = sorted;
+            std::sort(keys.begin(), keys.end());
+        }
+
+        size_t bytes() { return keys.capacity() * sizeof(int); }
+    };
+
+    volatile size_t sink;                       //keeps lookups from being optimized away
+
+    //present keys are the even numbers below 2n in random order, odd numbers are misses
+    template <class Subject>
+    void runAll(const char* name, size_t n, const Options& opt, std::vector<Row>& rows)
+    {
+        std::mt19937_64 rng(opt.seed ^ n);
+
+        std::vector<int> keys(n);
+        for (size_t i = 0; i < n; i++) keys[i] = (int)(2 * i);
+        std::shuffle(keys.begin(), keys.end(), rng);
+
+        std::vector<int> probes(opt.ops);
+        for (auto& p : probes) p = (int)(2 * (rng() % n));
+
+        bool slowUpdates = std::strcmp(name, "vector") == 0 && n > VECTOR_LIMIT;
+        Row base{ name, "", n, 0, 0, 0, 0, 0, 0, 0 };
+
+        size_t before = residentBytes();
+        Subject* s = new Subject();
+
+        Row inserted = base;
+        inserted.workload = "insert";
+
+        if (slowUpdates) s->bulk(keys);
+        else measure(inserted, n, [&](size_t i) { s->insert(keys[i]); });
+
+        //freed memory of an earlier run is reused, so the RSS growth can understate small structures
+        size_t rss = residentBytes();
+        double perKey = (rss > before) ? (double)(rss - before) / n : 0;
+        double heapPerKey = (double)s->bytes() / n;
+        auto finish = [&](Row row) { row.rss = rss; row.bytesPerKey = perKey; row.heapPerKey = heapPerKey; rows.push_back(row); };
+
+        if (!slowUpdates) finish(inserted);
+
+        {
+            Row row = base;
+            row.workload = "lookup-hit";
+            size_t found = 0;
+            measure(row, probes.size(), [&](size_t i) { found += s->find(probes[i]); });
+            sink = found;
+            finish(row);
+        }
+
+        {
+            Row row = base;
+            row.workload = "lookup-miss";
+            size_t found = 0;
+            measure(row, probes.size(), [&](size_t i) { found += s->find(probes[i] + 1); });
+            sink = found;
+            finish(row);
+        }
+
+        {
+            Row row = base;
+            row.workload = "range-scan";
+            size_t seen = 0;
+            size_t scans = (std::max)(probes.size() / 100, (size_t)1);
+            measure(row, scans, [&](size_t i) { seen += s->scan(probes[i], probes[i] + RANGE_WIDTH); });
+            sink = seen;
+            finish(row);
+        }
+
+        if (!slowUpdates)
+        {
+            //half lookups, a quarter inserts of fresh odd keys, a quarter deletes of present keys
+            Row row = base;
+            row.workload = "mixed";
+            size_t count = (std::min)(probes.size(), n);
+            size_t found = 0;
+
+            measure(row, count, [&](size_t i)
+                {
+                    switch (i % 4)
+                    {
+                    case 0:
+                    case 1: found += s->find(probes[i]); break;
+                    case 2: s->insert(keys[i] + 1); break;
+                    default: s->erase(keys[i]); break;
+                    }
+                });
+
+            sink = found;
+            finish(row);
+
+            row = base;
+            row.workload = "delete";
+            measure(row, n, [&](size_t i) { s->erase(keys[i]); });
+            finish(row);
+        }
+
+        delete s;
+    }
+
+    template <class Subject>
+    void runPattern(const char* name, size_t n, ds::KeyPattern pattern, const Options& opt, std::vector<Row>& rows)
+    {
+        if (std::strcmp(name, "vector") == 0 && n > VECTOR_LIMIT) return;
+
+        ds::WorkloadConfig config;
+        config.pattern = pattern;
+        config.seed = opt.seed ^ n;
+        config.keySpace = (int64_t)(2 * n);
+        config.insertPercent = 25;
+        config.deletePercent = 25;
+
+        ds::Workload workload(config);
+        std::vector<int64_t> keys = workload.preload(n);
+        std::vector<ds::WorkloadOp> ops;
+        workload.fill(ops, opt.ops);
+
+        size_t before = residentBytes();
+        Subject* s = new Subject();
+        for (int64_t k : keys) s->insert((int)k);
+
+        Row row{ name, std::string("mix-") + ds::Workload::patternName(pattern), n, 0, 0, 0, 0, 0, 0, 0 };
+        size_t found = 0;
+
+        measure(row, ops.size(), [&](size_t i)
+            {
+                switch (ops[i].kind)
+                {
+                case ds::WorkloadOpKind::INSERT: s->insert((int)ops[i].key); break;
+                case ds::WorkloadOpKind::REMOVE: s->erase((int)ops[i].key); break;
+                default: found += s->find((int)ops[i].key); break;
+                }
+            });
+
+        sink = found;
+        row.rss = residentBytes();
+        row.bytesPerKey = (row.rss > before) ? (double)(row.rss - before) / n : 0;
+        row.heapPerKey = (double)s->bytes() / n;
+        rows.push_back(row);
+
+        delete s;
+    }
+
+    std::vector<std::string> splitList(const std::string& s)
+    {
+        std::vector<std::string> items;
+        std::stringstream in(s);
+        std::string item;
+
+        while (std::getline(in, item, ','))
+            if (!item.empty()) items.push_back(item);
+
+        return items;
+    }
+
+    bool parse(int argc, char** argv, Options& opt)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) return false;
+            std::string value = argv[++i];
+
+            if (arg == "--sizes")
+            {
+                opt.sizes.clear();
+                for (auto& item : splitList(value)) opt.sizes.push_back((size_t)std::strtod(item.c_str(), NULL));      //accepts 1e6
+            }
+            else if (arg == "--structures") opt.structures = splitList(value);
+            else if (arg == "--format") opt.format = value;
+            else if (arg == "--out") opt.out = value;
+            else if (arg == "--ops") opt.ops = (size_t)std::strtod(value.c_str(), NULL);
+            else if (arg == "--seed") opt.seed = std::strtoull(value.c_str(), NULL, 10);
+            else if (arg == "--patterns")
+            {
+                opt.patterns.clear();
+
+                for (auto& item : splitList(value))
+                {
+                    ds::KeyPattern p;
+                    if (!ds::Workload::parsePattern(item.c_str(), p)) return false;
+                    opt.patterns.push_back(p);
+                }
+            }
+            else return false;
+        }
+
+        return opt.format == "csv" || opt.format == "json";
+    }
+
+    void write(std::ostream& out, const std::vector<Row>& rows, bool json)
+    {
+        char line[512];
+
+        if (!json) out << "structure,workload,keys,ops,ns_per_op,p50_ns,p99_ns,rss_bytes,bytes_per_key,heap_bytes_per_key\n";
+        else out << "[\n";
+
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const Row& r = rows[i];
+            const char* fmt = json
+                ? "  {\"structure\": \"%s\", \"workload\": \"%s\", \"keys\": %zu, \"ops\": %zu, \"ns_per_op\": %.2f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"rss_bytes\": %zu, \"bytes_per_key\": %.2f, \"heap_bytes_per_key\": %.2f}%s\n"
+                : "%s,%s,%zu,%zu,%.2f,%.0f,%.0f,%zu,%.2f,%.2f%s\n";
+
+            snprintf(line, sizeof(line), fmt, r.structure.c_str(), r.workload.c_str(), r.keys, r.ops, r.nsPerOp, r.p50, r.p99, r.rss, r.bytesPerKey, r.heapPerKey,
+                (json && i + 1 < rows.size()) ? "," : "");
+            out << line;
+        }
+
+        if (json) out << "]\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    if (!parse(argc, argv, opt))
+    {
+        std::cerr << "usage: Bench [--sizes 1e3,1e4,1e5,1e6] [--structures tree,set,vector] [--format csv|json] [--out file] [--ops n] [--seed n] [--patterns zipf,clustered,...]\n";
+        return 1;
+    }
+
+    std::vector<Row> rows;
+
+    for (size_t n : opt.sizes)
+    {
+        if (n == 0) continue;
+
+        for (auto& name : opt.structures)
+        {
+            std::cerr << name << " " << n << "\n";
+
+            if (name == "tree") runAll<TreeSubject>("tree", n, opt, rows);
+            else if (name == "set") runAll<SetSubject>("set", n, opt, rows);
+            else if (name == "vector") runAll<VectorSubject>("vector", n, opt, rows);
+
+            for (ds::KeyPattern p : opt.patterns)
+            {
+                if (name == "tree") runPattern<TreeSubject>("tree", n, p, opt, rows);
+                else if (name == "set") runPattern<SetSubject>("set", n, p, opt, rows);
+                else if (name == "vector") runPattern<VectorSubject>("vector", n, p, opt, rows);
+            }
+        }
+    }
+
+    if (opt.out.empty())
+    {
+        write(std::cout, rows, opt.format == "json");
+        return 0;
+    }
+
+    std::ofstream file(opt.out);
+    if (!file)
+    {
+        std::cerr << "cannot open " << opt.out << "\n";
+        return 1;
+    }
+
+    write(file, rows, opt.format == "json");
+    return 0;
+}
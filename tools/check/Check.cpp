@@ -0,0 +1,374 @@
+//self-checks for behaviour the visualizer cannot show: key types the generic containers must accept and
+//the invariants of the optional features. every check prints its name and ok or FAIL, the exit code is
+//the number of failed checks
+//
+//  Check [name...]
+//  g++ -std=c++17 -O2 -pthread -I../../src Check.cpp -o Check
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <array>
+#include <map>
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "IntervalTree.hpp"
+#include "CompressedTree.hpp"
+#include "Lsm.hpp"
+#include "FrozenTree.hpp"
+#include "StringTree.hpp"
+#include "Multiset.hpp"
+
+namespace
+{
+    int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; return; } } while (0)
+
+    //floating point keys hash by value, so the tree compiles for them and the filter and cache accept them
+    void floatingKeys()
+    {
+        ds::TwoThreeTree<double> tree;
+        tree.setBloomFilter(true);
+        tree.setLookupCache(64);
+
+        for (int i = 0; i < 1000; i++) tree.insert(i * 0.5);
+
+        CHECK(tree.searchFor(-0.0) != nullptr);
+        CHECK(tree.searchFor(0.0) != nullptr);
+        CHECK(tree.searchFor(499.5) != nullptr);
+        CHECK(tree.searchFor(0.25) == nullptr);
+
+        ds::TwoThreeTree<double> other;
+        for (int i = 999; i >= 0; i--) other.insert(i * 0.5);
+        CHECK(tree.rootHash() == other.rootHash());
+
+        ds::TwoThreeTree<float> floats;
+        floats.insert(1.5f);
+        CHECK(floats.searchFor(1.5f) != nullptr);
+    }
+
+    //char then int: three padding bytes that operator == ignores
+    struct Padded
+    {
+        char tag;
+        int value;
+
+        bool operator < (const Padded& p) const { return value < p.value; }
+        bool operator > (const Padded& p) const { return p < *this; }
+        bool operator == (const Padded& p) const { return value == p.value; }
+    };
+
+    static_assert(ds::HasKeyHash<double>::value, "floating point keys hash by value");
+    static_assert(!ds::HasKeyHash<Padded>::value, "padded keys must not pass for hashable");
+
+    //padded and floating point keys work in the containers as long as no hashing feature is turned on
+    void paddedKeys()
+    {
+        ds::TwoThreeTree<Padded> tree;
+        for (int i = 0; i < 100; i++) tree.insert(Padded{ (char)i, i });
+
+        CHECK(tree.searchFor(Padded{ 0, 42 }) != nullptr);
+        CHECK(tree.searchFor(Padded{ 0, 100 }) == nullptr);
+
+        ds::IntervalTree<double> intervals;
+        intervals.insert(1.0, 2.5);
+        intervals.insert(2.0, 3.0);
+
+        size_t hits = 0;
+        intervals.forOverlapping(2.2, 2.4, [&hits](double, double) { hits++; });
+        CHECK(hits == 2);
+
+        //size() follows changes made through the tree directly
+        intervals.insert(5.0, 6.0);
+        CHECK(intervals.size() == 3);
+        intervals.getTree().eraseRange(ds::IntervalKey<double>{ 1.5, 0, 0 }, ds::IntervalKey<double>{ 9.0, 0, 0 });
+        CHECK(intervals.size() == 1 && intervals.contains(1.0, 2.5));
+    }
+
+    //searchFor in write-buffered mode returns a node holding the key even when the key is only buffered,
+    //Multiset relies on it to update counts in place
+    void bufferedSearch()
+    {
+        ds::TwoThreeMultiset<int> set;
+        set.getTree().setWriteBuffer(4);
+
+        std::map<int, size_t> model;
+        std::mt19937 rng(7);
+
+        for (int i = 0; i < 20000; i++)
+        {
+            int k = (int)(rng() % 500);
+
+            if (rng() % 3 == 0)
+            {
+                bool had = model[k] > 0;
+                CHECK(set.eraseOne(k) == had);
+                if (had) model[k]--;
+            }
+            else
+            {
+                CHECK(set.insert(k) == ++model[k]);
+            }
+
+            int probe = (int)(rng() % 500);
+            CHECK(set.count(probe) == model[probe]);
+
+            ds::TwoThreeNode<ds::CountedKey<int>>* r = set.getTree().searchFor(ds::CountedKey<int>{ probe, 0 });
+            CHECK((r != nullptr) == (model[probe] > 0));
+            CHECK(r == nullptr || r->k1.key == probe || (r->n == 2 && r->k2.key == probe));
+        }
+    }
+
+    //multiset replicas agree on rootHash() only with the same multiplicities, and a count changed in place
+    //leaves the same hash as building the multiset from scratch
+    void multisetHash()
+    {
+        ds::TwoThreeMultiset<int> a, b;
+        std::mt19937 rng(36);
+
+        for (int i = 0; i < 5000; i++)
+        {
+            int k = (int)(rng() % 300);
+            a.insert(k);
+            b.insert(k);
+        }
+
+        CHECK(a.getTree().rootHash() == b.getTree().rootHash());
+
+        a.insert(17);
+        CHECK(a.getTree().rootHash() != b.getTree().rootHash());
+
+        std::vector<std::pair<int, bool>> reported;
+        a.getTree().diff(b.getTree(), [&reported](const ds::CountedKey<int>& c, bool inA) { reported.push_back({ c.key, inA }); });
+        CHECK(reported.size() == 2 && reported[0].first == 17 && reported[1].first == 17 && reported[0].second != reported[1].second);
+
+        a.eraseOne(17);
+        CHECK(a.getTree().rootHash() == b.getTree().rootHash());
+
+        for (int i = 0; i < 2000; i++) a.eraseOne((int)(rng() % 300));
+
+        ds::TwoThreeMultiset<int> fresh;
+        a.forRange(0, 300, [&fresh](int key, size_t count) { for (size_t c = 0; c < count; c++) fresh.insert(key); });
+        CHECK(a.getTree().rootHash() == fresh.getTree().rootHash());
+    }
+
+    //decode() and contains(), SSE2 where the build has it, agree with the scalar gap reader for every gap
+    //width and every count, including the partly filled last row of lanes
+    void packedDecode()
+    {
+        std::mt19937_64 rng(38);
+
+        for (uint32_t width = 0; width <= 32; width++)
+        {
+            for (uint32_t count = 1; count <= ds::PACKED_BLOCK_KEYS; count++)
+            {
+                //one gap of exactly width bits, the others small enough to keep the block within 2^32
+                uint64_t top = (width == 0) ? 0 : 1ull << (width - 1);
+                uint64_t room = (std::min)((UINT32_MAX - top) / count, 2 * top);
+
+                std::vector<int64_t> keys(1, (int64_t)(rng() >> 2) - ((int64_t)1 << 60));
+                for (uint32_t i = 1; i < count; i++)
+                {
+                    uint64_t gap = (i == 1) ? top : ((room == 0) ? 0 : rng() % room);
+                    keys.push_back(keys.back() + 1 + (int64_t)gap);
+                }
+
+                ds::PackedBlock block;
+                block.encode(keys.data(), keys.data() + keys.size());
+
+                uint32_t fast[ds::PACKED_BLOCK_KEYS], slow[ds::PACKED_BLOCK_KEYS];
+                block.decode(fast);
+                block.decodeScalar(slow);
+
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    CHECK(fast[i] == slow[i]);
+                    CHECK(keys[0] + (int64_t)slow[i] == keys[i]);
+                    CHECK(block.contains(keys[i]));
+                    CHECK(!block.contains(keys[i] + 1) || (i + 1 < count && keys[i + 1] == keys[i] + 1));
+                }
+
+                CHECK(!block.contains(keys[0] - 1));
+                CHECK(!block.contains(keys.back() + 1));
+                CHECK(!block.contains(keys.back() + 2));
+            }
+        }
+    }
+
+    constexpr auto smallFrozen = ds::makeFrozenTree(std::array<int, 7>{ 40, 10, 30, 20, 70, 60, 50 });
+    static_assert(smallFrozen.depth() == 2 && smallFrozen.contains(30) && !smallFrozen.contains(35), "frozen trees answer in constant expressions");
+
+    template <size_t N>
+    void frozenSize(std::mt19937& rng)
+    {
+        std::array<int, N> keys{};
+        for (auto& k : keys) k = (int)(rng() % (3 * N)) * 2;      //even keys with duplicates
+
+        std::set<int> model(keys.begin(), keys.end());
+        ds::FrozenTree<int, N> tree(keys);
+
+        CHECK(tree.size() == model.size());
+
+        for (int k = -2; k <= (int)(6 * N) + 2; k++)
+            CHECK(tree.contains(k) == (model.count(k) > 0));
+    }
+
+    //contains() picks a fixed-depth descent by height, every height a size can reach must answer like a set
+    void frozenContains()
+    {
+        std::mt19937 rng(37);
+
+        for (int i = 0; i < 20; i++)
+        {
+            frozenSize<1>(rng);
+            frozenSize<2>(rng);
+            frozenSize<3>(rng);
+            frozenSize<8>(rng);
+            frozenSize<31>(rng);
+            frozenSize<200>(rng);
+            frozenSize<3000>(rng);
+        }
+    }
+
+    std::string randomPath(std::mt19937& rng)
+    {
+        static const char* hosts[] = { "https://example.com/", "https://example.org/static/", "http://a.b/" };
+        std::string s = hosts[rng() % 3];
+
+        for (int depth = (int)(rng() % 4); depth >= 0; depth--)
+        {
+            s += "dir" + std::to_string(rng() % 6);
+            s += (depth > 0) ? '/' : '.';
+        }
+
+        return s + std::to_string(rng() % 1000);
+    }
+
+    //front-coded keys answer like a std::set through the StringTree and through the tree's own search, Bloom
+    //filter and cache, and a shrunk arena holds fewer bytes than the keys it stores
+    void stringFrontCoding()
+    {
+        ds::StringTree tree;
+        tree.getTree().setBloomFilter(true);
+        tree.getTree().setLookupCache(256);
+
+        std::set<std::string> model;
+        std::mt19937 rng(39);
+
+        for (int i = 0; i < 60000; i++)
+        {
+            std::string s = randomPath(rng);
+
+            if (rng() % 4 == 0)
+            {
+                CHECK(tree.erase(s) == (model.erase(s) > 0));
+            }
+            else
+            {
+                CHECK(tree.insert(s) == model.insert(s).second);
+            }
+
+            std::string q = randomPath(rng);
+            CHECK(tree.contains(q) == (model.count(q) > 0));
+            CHECK((tree.getTree().searchFor(ds::stringKey(q)) != nullptr) == (model.count(q) > 0));
+        }
+
+        CHECK(tree.size() == model.size());
+        CHECK(tree.insert("") && tree.contains("") && tree.erase(""));
+
+        tree.shrink();
+        CHECK(tree.arenaBytes() < tree.liveBytes() / 2);
+
+        std::vector<std::string> keys;
+        tree.forEach([&keys](std::string_view k) { keys.push_back(std::string(k)); });
+        CHECK(keys == std::vector<std::string>(model.begin(), model.end()));
+
+        std::vector<std::string> range;
+        tree.forRange("https://example.com/dir2", "https://example.com/dir3", [&range](std::string_view k) { range.push_back(std::string(k)); });
+        CHECK(range == std::vector<std::string>(model.lower_bound("https://example.com/dir2"), model.upper_bound("https://example.com/dir3")));
+
+        for (auto& k : model) CHECK(tree.contains(k));
+    }
+
+    //puts, deletes and reads against a model while four threads compact small runs, so batches of one level
+    //finish out of order. a deleted key must stay deleted whichever compaction lands first
+    void lsmConcurrentCompaction()
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "check-lsm";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+
+        std::map<int64_t, bool> model;
+        std::mt19937 rng(31);
+
+        {
+            ds::LsmTree<int64_t> lsm;
+            CHECK(lsm.open(dir.string().c_str(), 4));
+            lsm.setMemtableLimit(16);
+            lsm.setFanIn(2);
+
+            for (int i = 0; i < 40000; i++)
+            {
+                int64_t k = (int64_t)(rng() % 500);
+
+                switch (rng() % 3)
+                {
+                case 0: lsm.insert(k); model[k] = true; break;
+                case 1: lsm.deleteNode(k); model[k] = false; break;
+                default: CHECK(lsm.searchFor(k) == model[k]); break;
+                }
+            }
+
+            lsm.waitForCompaction();
+            for (auto& entry : model) CHECK(lsm.searchFor(entry.first) == entry.second);
+        }
+
+        ds::LsmTree<int64_t> reopened;
+        CHECK(reopened.open(dir.string().c_str(), 1));
+        for (auto& entry : model) CHECK(reopened.searchFor(entry.first) == entry.second);
+
+        reopened.close();
+        std::filesystem::remove_all(dir);
+    }
+
+    struct Check
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Check checks[] =
+    {
+        { "floating-keys", floatingKeys },
+        { "padded-keys", paddedKeys },
+        { "buffered-search", bufferedSearch },
+        { "multiset-hash", multisetHash },
+        { "packed-decode", packedDecode },
+        { "frozen-contains", frozenContains },
+        { "string-front-coding", stringFrontCoding },
+        { "lsm-concurrent-compaction", lsmConcurrentCompaction },
+    };
+}
+
+int main(int argc, char** argv)
+{
+    for (const Check& check : checks)
+    {
+        bool wanted = (argc < 2);
+        for (int i = 1; i < argc; i++) wanted |= (std::strcmp(argv[i], check.name) == 0);
+        if (!wanted) continue;
+
+        int before = failures;
+        check.run();
+        std::printf("%-24s %s\n", check.name, (failures == before) ? "ok" : "FAIL");
+    }
+
+    return failures;
+}
@@ -0,0 +1,454 @@
+//headless driver that pushes scripted operations through a ds::TwoThreeTree<int64_t>. commands are read from a
+//file or stdin in large chunks, run in batches and their results written through one output buffer; a summary
+//with counts and timing goes to stderr
+//
+//  Cli [--binary] [--quiet] [--batch n] [--stats] [--trace path [--trace-capacity n] [--timestamps]] [file | -]
+//
+//text commands, one per line, '#' starts a comment:
+//  i <key>        insert, prints 1 if the key was added and 0 if it was present
+//  d <key>        delete, prints 1 if the key was removed
+//  s <key>        search, prints 1 if the key is present
+//  r <lo> <hi>    range, prints the number of keys in [lo, hi] followed by the keys
+//(insert, delete, search and range are accepted as well)
+//binary commands are one op byte ('i', 'd', 's' or 'r') followed by the key, and for 'r' the upper bound,
+//as little-endian int64
+//
+//--trace records every insert, delete and search into a ds::TraceRecorder ring file for Replay, a trace
+//that could not be written completely makes the exit status 1
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "TwoThreeTree.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t READ_CHUNK = 1 << 20;
+    const size_t WRITE_CHUNK = 1 << 20;
+
+    struct Command
+    {
+        char op;                                //'i', 'd', 's' or 'r'
+        int64_t key;
+        int64_t hi;
+    };
+
+    struct Options
+    {
+        bool binary{ false };
+        bool quiet{ false };                    //run the commands without printing their results
+        bool stats{ false };
+        size_t batch{ 65536 };
+        const char* path{ NULL };               //NULL or "-" for stdin
+        const char* trace{ NULL };
+        uint64_t traceCapacity{ 1 << 24 };      //records the trace ring keeps
+        bool timestamps{ false };
+    };
+
+    FILE* openInput(const char* path)
+    {
+        if (path == NULL || std::strcmp(path, "-") == 0)
+        {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            return stdin;
+        }
+
+#ifdef _MSC_VER
+        FILE* f = NULL;
+        if (fopen_s(&f, path, "rb") != 0) return NULL;
+        return f;
+#else
+        return std::fopen(path, "rb");
+#endif
+    }
+
+    //refillable window over the input, so commands are parsed straight out of large reads
+    class Reader
+    {
+    public:
+        explicit Reader(FILE* f) : file(f), buffer(READ_CHUNK) {}
+
+        //makes at least n bytes available from pos unless the input ends first
+        bool ensure(size_t n)
+        {
+            while (end - pos < n && !eof)
+            {
+                if (pos > 0)
+                {
+                    std::memmove(buffer.data(), buffer.data() + pos, end - pos);
+                    end -= pos;
+                    pos = 0;
+                }
+
+                if (buffer.size() - end < READ_CHUNK / 2) buffer.resize(buffer.size() * 2);
+
+                size_t got = std::fread(buffer.data() + end, 1, buffer.size() - end, file);
+                if (got == 0) eof = true;
+                end += got;
+            }
+
+            return end - pos >= n;
+        }
+
+        //next line without its terminator, false at the end of the input
+        bool line(const char*& b, const char*& e)
+        {
+            size_t scanned = 0;
+
+            for (;;)
+            {
+                const char* nl = (const char*)std::memchr(buffer.data() + pos + scanned, '\n', end - pos - scanned);
+
+                if (nl != NULL)
+                {
+                    b = buffer.data() + pos;
+                    e = nl;
+                    pos = nl + 1 - buffer.data();
+                    break;
+                }
+
+                scanned = end - pos;
+
+                if (!ensure(scanned + 1))
+                {
+                    if (pos == end) return false;
+
+                    b = buffer.data() + pos;
+                    e = buffer.data() + end;
+                    pos = end;
+                    break;
+                }
+            }
+
+            if (e > b && e[-1] == '\r') e--;
+            return true;
+        }
+
+        const char* take(size_t n)
+        {
+            const char* p = buffer.data() + pos;
+            pos += n;
+            return p;
+        }
+
+    private:
+        FILE* file;
+        std::vector<char> buffer;
+        size_t pos{ 0 };
+        size_t end{ 0 };
+        bool eof{ false };
+    };
+
+    class Writer
+    {
+    public:
+        ~Writer()
+        {
+            flush();
+        }
+
+        void put(const char* s, size_t n)
+        {
+            out.append(s, n);
+            if (out.size() >= WRITE_CHUNK) flush();
+        }
+
+        void put(char c)
+        {
+            out.push_back(c);
+            if (out.size() >= WRITE_CHUNK) flush();
+        }
+
+        void put(int64_t v)
+        {
+            char digits[24];
+            auto r = std::to_chars(digits, digits + sizeof(digits), v);
+            put(digits, r.ptr - digits);
+        }
+
+        void flush()
+        {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+
+    private:
+        std::string out;
+    };
+
+    const char* skipSpace(const char* p, const char* e)
+    {
+        while (p < e && (*p == ' ' || *p == '\t')) p++;
+        return p;
+    }
+
+    bool parseInt(const char*& p, const char* e, int64_t& v)
+    {
+        p = skipSpace(p, e);
+        auto r = std::from_chars(p, e, v);
+        if (r.ec != std::errc()) return false;
+
+        p = r.ptr;
+        return true;
+    }
+
+    //0 for a blank or comment line, -1 for a malformed one, 1 for a command
+    int parseText(const char* p, const char* e, Command& c)
+    {
+        p = skipSpace(p, e);
+        if (p == e || *p == '#') return 0;
+
+        const char* word = p;
+        while (p < e && *p != ' ' && *p != '\t') p++;
+
+        std::string_view w(word, p - word);
+        if (w == "i" || w == "insert") c.op = 'i';
+        else if (w == "d" || w == "delete") c.op = 'd';
+        else if (w == "s" || w == "search") c.op = 's';
+        else if (w == "r" || w == "range") c.op = 'r';
+        else return -1;
+
+        if (!parseInt(p, e, c.key)) return -1;
+        if (c.op == 'r' && !parseInt(p, e, c.hi)) return -1;
+
+        p = skipSpace(p, e);
+        return (p == e || *p == '#') ? 1 : -1;
+    }
+
+    int64_t readInt64(const char* p)
+    {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; i--) v = (v << 8) | (unsigned char)p[i];
+        return (int64_t)v;
+    }
+
+    //0 at the end of the input, -1 for a bad op byte or a truncated record, 1 for a command
+    int parseBinary(Reader& in, Command& c)
+    {
+        if (!in.ensure(1)) return 0;
+
+        c.op = *in.take(1);
+        if (c.op != 'i' && c.op != 'd' && c.op != 's' && c.op != 'r') return -1;
+
+        size_t size = (c.op == 'r') ? 16 : 8;
+        if (!in.ensure(size)) return -1;
+
+        const char* p = in.take(size);
+        c.key = readInt64(p);
+        if (c.op == 'r') c.hi = readInt64(p + 8);
+        return 1;
+    }
+
+    bool parse(int argc, char** argv, Options& opt)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+
+            if (arg == "--binary") opt.binary = true;
+            else if (arg == "--quiet") opt.quiet = true;
+            else if (arg == "--stats") opt.stats = true;
+            else if (arg == "--timestamps") opt.timestamps = true;
+            else if (arg == "--batch" && i + 1 < argc) opt.batch = (std::max)((size_t)std::strtoull(argv[++i], NULL, 10), (size_t)1);
+            else if (arg == "--trace" && i + 1 < argc) opt.trace = argv[++i];
+            else if (arg == "--trace-capacity" && i + 1 < argc) opt.traceCapacity = std::strtoull(argv[++i], NULL, 10);
+            else if (opt.path == NULL && (arg == "-" || arg[0] != '-')) opt.path = argv[i];
+            else return false;
+        }
+
+        return true;
+    }
+
+    double millis(Clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    if (!parse(argc, argv, opt))
+    {
+        std::fprintf(stderr, "usage: Cli [--binary] [--quiet] [--batch n] [--stats] [--trace path [--trace-capacity n] [--timestamps]] [file | -]\n");
+        return 1;
+    }
+
+    FILE* file = openInput(opt.path);
+    if (file == NULL)
+    {
+        std::fprintf(stderr, "cannot open %s\n", opt.path);
+        return 1;
+    }
+
+    ds::TwoThreeTree<int64_t> tree;
+    ds::TraceRecorder<int64_t> trace;
+
+    if (opt.trace != NULL && !trace.open(opt.trace, opt.traceCapacity, opt.timestamps))
+    {
+        std::fprintf(stderr, "cannot create trace %s\n", opt.trace);
+        if (file != stdin) std::fclose(file);
+        return 1;
+    }
+
+    Reader in(file);
+    Writer out;
+
+    std::vector<Command> batch;
+    batch.reserve(opt.batch);
+
+    size_t counts[4] = { 0, 0, 0, 0 };         //insert, delete, search, range
+    size_t errors = 0, lines = 0;
+    Clock::duration parseTime{}, runTime{};
+    bool done = false;
+
+    while (!done)
+    {
+        //parse a batch
+        Clock::time_point t = Clock::now();
+        batch.clear();
+
+        while (batch.size() < opt.batch)
+        {
+            Command c;
+            int r;
+
+            if (opt.binary)
+            {
+                r = parseBinary(in, c);
+                if (r == 0) { done = true; break; }
+            }
+            else
+            {
+                const char* b;
+                const char* e;
+                if (!in.line(b, e)) { done = true; break; }
+
+                lines++;
+                r = parseText(b, e, c);
+                if (r == 0) continue;
+            }
+
+            if (r < 0)
+            {
+                errors++;
+                if (opt.binary)
+                {
+                    std::fprintf(stderr, "malformed binary record after %zu commands\n", counts[0] + counts[1] + counts[2] + counts[3] + batch.size());
+                    done = true;
+                    break;
+                }
+
+                std::fprintf(stderr, "malformed command on line %zu\n", lines);
+                continue;
+            }
+
+            batch.push_back(c);
+        }
+
+        //run it
+        Clock::time_point mid = Clock::now();
+        parseTime += mid - t;
+
+        for (const Command& c : batch)
+        {
+            switch (c.op)
+            {
+            case 'i':
+            {
+                bool ok = tree.insert(c.key);
+                trace.record(ds::TraceOp::INSERT, c.key, ok);
+                counts[0]++;
+                if (!opt.quiet) out.put(ok ? "1\n" : "0\n", 2);
+                break;
+            }
+
+            case 'd':
+            {
+                bool ok = tree.deleteNode(c.key);
+                trace.record(ds::TraceOp::REMOVE, c.key, ok);
+                counts[1]++;
+                if (!opt.quiet) out.put(ok ? "1\n" : "0\n", 2);
+                break;
+            }
+
+            case 's':
+            {
+                bool ok = tree.searchFor(c.key) != NULL;
+                trace.record(ds::TraceOp::SEARCH, c.key, ok);
+                counts[2]++;
+                if (!opt.quiet) out.put(ok ? "1\n" : "0\n", 2);
+                break;
+            }
+
+            default:
+            {
+                counts[3]++;
+
+                if (opt.quiet)
+                {
+                    tree.forRange(c.key, c.hi, [](int64_t) {});
+                    break;
+                }
+
+                //the keys go first so the count can be put in front of them
+                std::vector<int64_t> keys;
+                tree.forRange(c.key, c.hi, [&keys](int64_t k) { keys.push_back(k); });
+
+                out.put((int64_t)keys.size());
+                for (int64_t k : keys)
+                {
+                    out.put(' ');
+                    out.put(k);
+                }
+                out.put('\n');
+                break;
+            }
+            }
+        }
+
+        runTime += Clock::now() - mid;
+    }
+
+    out.flush();
+    bool traced = trace.close();
+    if (!traced) std::fprintf(stderr, "writing trace %s failed, it is incomplete\n", opt.trace);
+    if (file != stdin) std::fclose(file);
+
+    size_t total = counts[0] + counts[1] + counts[2] + counts[3];
+    double runMs = millis(runTime);
+
+    std::fprintf(stderr, "%zu commands (%zu insert, %zu delete, %zu search, %zu range), %zu malformed\n",
+        total, counts[0], counts[1], counts[2], counts[3], errors);
+    std::fprintf(stderr, "parse %.3f ms, run %.3f ms, %.0f ops/s, %.1f ns/op\n",
+        millis(parseTime), runMs, (runMs > 0) ? total / (runMs / 1000.0) : 0.0, (total > 0) ? runMs * 1e6 / total : 0.0);
+
+    if (opt.stats)
+    {
+        ds::TreeStats s = tree.stats();
+        std::fprintf(stderr, "keys %zu, nodes %zu (%zu 2-nodes, %zu 3-nodes), height %zu, %zu bytes\n",
+            (size_t)s.keys, (size_t)s.nodes, (size_t)s.twoNodes, (size_t)s.threeNodes, (size_t)s.height, (size_t)s.bytes);
+    }
+
+    if (errors > 0) return 2;
+    return traced ? 0 : 1;
+}
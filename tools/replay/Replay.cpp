@@ -0,0 +1,146 @@
+//replays an operation trace recorded by ds::TraceRecorder<int64_t> (for instance Cli --trace) against a freshly
+//configured ds::TwoThreeTree<int64_t> at full speed, printing throughput and a latency histogram per phase
+//
+//  Replay [--phase n] [--sample n] [--cache slots] [--bloom] [--write-buffer n] [--compact n] [--counters] trace
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "TwoThreeTree.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+    struct Options
+    {
+        uint64_t phase{ 1000000 };              //records per phase, 0 for one phase
+        uint64_t sample{ 8 };                   //one op in sample is timed for the histogram
+        size_t cache{ 0 };
+        bool bloom{ false };
+        size_t writeBuffer{ 0 };
+        uint64_t compact{ 0 };                  //compaction budget in nodes run after every phase, 0 for none
+        bool counters{ false };
+        const char* path{ NULL };
+    };
+
+    bool parse(int argc, char** argv, Options& opt)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if (arg == "--bloom") opt.bloom = true;
+            else if (arg == "--counters") opt.counters = true;
+            else if (arg == "--phase" && hasValue) opt.phase = std::strtoull(argv[++i], NULL, 10);
+            else if (arg == "--sample" && hasValue) opt.sample = std::strtoull(argv[++i], NULL, 10);
+            else if (arg == "--cache" && hasValue) opt.cache = (size_t)std::strtoull(argv[++i], NULL, 10);
+            else if (arg == "--write-buffer" && hasValue) opt.writeBuffer = (size_t)std::strtoull(argv[++i], NULL, 10);
+            else if (arg == "--compact" && hasValue) opt.compact = std::strtoull(argv[++i], NULL, 10);
+            else if (opt.path == NULL && arg[0] != '-') opt.path = argv[i];
+            else return false;
+        }
+
+        return opt.path != NULL;
+    }
+
+    void printPhase(size_t index, const ds::TracePhase& p)
+    {
+        std::printf("phase %zu: %llu ops in %.3f ms, %.0f ops/s", index, (unsigned long long)p.ops, p.seconds * 1000, (p.seconds > 0) ? p.ops / p.seconds : 0.0);
+        if (p.recordedSeconds > 0) std::printf(" (recorded %.0f ops/s)", p.ops / p.recordedSeconds);
+        std::printf(", p50 <%llu ns, p99 <%llu ns, %llu mismatched\n", (unsigned long long)p.quantile(0.5), (unsigned long long)p.quantile(0.99), (unsigned long long)p.mismatches);
+
+        //one bar per non-empty bucket, 50 marks for the fullest
+        uint64_t peak = 0;
+        for (uint64_t n : p.histogram) peak = (std::max)(peak, n);
+
+        for (int b = 0; b < ds::TRACE_HISTOGRAM_BUCKETS; b++)
+        {
+            if (p.histogram[b] == 0) continue;
+
+            int marks = (int)((p.histogram[b] * 50 + peak - 1) / peak);
+            std::printf("  <%10llu ns %10llu %s\n", (unsigned long long)1 << b, (unsigned long long)p.histogram[b], std::string(marks, '#').c_str());
+        }
+    }
+
+    template <class Tree>
+    int run(const Options& opt, const ds::TraceReader<int64_t>& trace, Tree& tree)
+    {
+        if (opt.cache > 0) tree.setLookupCache(opt.cache);
+        if (opt.bloom) tree.setBloomFilter(true);
+        if (opt.writeBuffer > 0) tree.setWriteBuffer(opt.writeBuffer);
+
+        //phases are replayed one at a time so compaction can run between them
+        uint64_t phase = (opt.phase > 0) ? opt.phase : trace.size();
+
+        ds::TracePhase total;
+        size_t index = 0;
+
+        for (uint64_t begin = 0; begin < trace.size(); begin += phase, index++)
+        {
+            ds::TracePhase p = ds::replayTrace(trace, tree, begin, (std::min)(begin + phase, trace.size()), opt.sample);
+            printPhase(index, p);
+
+            total.ops += p.ops;
+            total.mismatches += p.mismatches;
+            total.seconds += p.seconds;
+            total.recordedSeconds += p.recordedSeconds;
+            total.sampled += p.sampled;
+            for (int b = 0; b < ds::TRACE_HISTOGRAM_BUCKETS; b++) total.histogram[b] += p.histogram[b];
+
+            if (opt.compact > 0) tree.compact((size_t)opt.compact);
+        }
+
+        std::printf("total: %llu ops in %.3f ms, %.0f ops/s, p50 <%llu ns, p99 <%llu ns, %llu mismatched\n", (unsigned long long)total.ops, total.seconds * 1000,
+            (total.seconds > 0) ? total.ops / total.seconds : 0.0, (unsigned long long)total.quantile(0.5), (unsigned long long)total.quantile(0.99), (unsigned long long)total.mismatches);
+
+        ds::TreeStats s = tree.stats();
+        std::printf("tree: %zu keys, height %d, %zu bytes\n", s.keys, s.height, s.bytes);
+
+        if (opt.counters)
+        {
+            const ds::OpCounters& c = s.ops;
+            std::printf("ops: %llu lookups, %llu comparisons, %llu splits, %llu merges, %llu left rotations, %llu right rotations\n",
+                (unsigned long long)c.lookups, (unsigned long long)c.comparisons, (unsigned long long)c.splits, (unsigned long long)c.merges,
+                (unsigned long long)c.rotateLefts, (unsigned long long)c.rotateRights);
+        }
+
+        return (total.mismatches > 0 && !trace.wrapped()) ? 2 : 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    if (!parse(argc, argv, opt))
+    {
+        std::fprintf(stderr, "usage: Replay [--phase n] [--sample n] [--cache slots] [--bloom] [--write-buffer n] [--compact n] [--counters] trace\n");
+        return 1;
+    }
+
+    ds::TraceReader<int64_t> trace;
+    if (!trace.open(opt.path))
+    {
+        std::fprintf(stderr, "%s is not a trace of 64-bit keys\n", opt.path);
+        return 1;
+    }
+
+    std::printf("%llu records%s%s\n", (unsigned long long)trace.size(), trace.hasTimestamps() ? ", timestamped" : "",
+        trace.wrapped() ? ", ring wrapped: the replay starts mid-stream and results may differ from the recorded ones" : "");
+
+    //counting every comparison costs time, so the counters are opt-in
+    if (opt.counters)
+    {
+        ds::TwoThreeTree<int64_t, ds::CountingStats> tree;
+        return run(opt, trace, tree);
+    }
+
+    ds::TwoThreeTree<int64_t> tree;
+    return run(opt, trace, tree);
+}
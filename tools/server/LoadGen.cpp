@@ -0,0 +1,293 @@
+//load generator for Server, Linux only. every connection runs on its own thread and keeps up to --pipeline
+//requests in flight, drawing its keys from a ds::Workload seeded per connection. prints the throughput
+//over all connections and the latency of a request from its send to the arrival of its response
+//
+//  LoadGen [--socket path] [--connections n] [--ops n] [--pipeline n] [--insert pct] [--delete pct]
+//          [--range pct] [--range-width n] [--pattern name] [--key-space n] [--seed n]
+//  g++ -std=c++17 -O2 -pthread -I../../src LoadGen.cpp -o LoadGen
+
+#ifndef __linux__
+#error "the load generator talks to the epoll based IPC server and only builds on Linux"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Workload.hpp"
+#include "Protocol.hpp"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Options
+    {
+        std::string socket{ "/tmp/twothreetree.sock" };
+        unsigned connections{ 4 };
+        size_t ops{ 100000 };                   //per connection
+        size_t pipeline{ 16 };                  //requests in flight per connection
+        unsigned insertPercent{ 10 };
+        unsigned deletePercent{ 0 };
+        unsigned rangePercent{ 0 };             //share of the searches sent as range queries instead
+        int64_t rangeWidth{ 64 };
+        ds::KeyPattern pattern{ ds::KeyPattern::UNIFORM };
+        int64_t keySpace{ 1 << 24 };
+        uint64_t seed{ 1 };
+    };
+
+    struct ConnectionResult
+    {
+        std::vector<uint32_t> latencies;        //ns, one per answered request
+        uint64_t errors{ 0 };                   //bad requests, out of order ids and lost connections
+        uint64_t hits{ 0 };                     //responses with IPC_TRUE
+        uint64_t rangeKeys{ 0 };
+    };
+
+    bool writeAll(int fd, const char* p, size_t n)
+    {
+        while (n > 0)
+        {
+            ssize_t w = write(fd, p, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+
+            p += w;
+            n -= (size_t)w;
+        }
+
+        return true;
+    }
+
+    int connectTo(const std::string& path)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return -1;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    //the requests are encoded before the clock starts, so drawing keys is not part of the measurement
+    std::vector<char> encode(const Options& opt, unsigned index, std::vector<size_t>& offsets)
+    {
+        ds::WorkloadConfig config;
+        config.pattern = opt.pattern;
+        config.seed = opt.seed + index;
+        config.keySpace = opt.keySpace;
+        config.insertPercent = opt.insertPercent;
+        config.deletePercent = opt.deletePercent;
+
+        ds::Workload workload(config);
+        ds::WorkloadRandom rng(config.seed ^ 0x5eedULL);
+
+        std::vector<char> out;
+        offsets.clear();
+        offsets.reserve(opt.ops + 1);
+
+        for (size_t i = 0; i < opt.ops; i++)
+        {
+            ds::WorkloadOp op = workload.next();
+
+            ds::IpcRequest req{};
+            req.id = (uint32_t)i;
+            req.key = op.key;
+
+            switch (op.kind)
+            {
+            case ds::WorkloadOpKind::INSERT: req.op = ds::IPC_INSERT; break;
+            case ds::WorkloadOpKind::REMOVE: req.op = ds::IPC_REMOVE; break;
+            default: req.op = (rng.below(100) < opt.rangePercent) ? ds::IPC_RANGE : ds::IPC_SEARCH; break;
+            }
+
+            offsets.push_back(out.size());
+            out.insert(out.end(), (const char*)&req, (const char*)&req + sizeof(req));
+
+            if (req.op == ds::IPC_RANGE)
+            {
+                int64_t hi = req.key + opt.rangeWidth;
+                out.insert(out.end(), (const char*)&hi, (const char*)&hi + sizeof(hi));
+            }
+        }
+
+        offsets.push_back(out.size());
+        return out;
+    }
+
+    void drive(const Options& opt, int fd, const std::vector<char>& requests, const std::vector<size_t>& offsets, ConnectionResult& result)
+    {
+        std::vector<Clock::time_point> sentAt(opt.ops);
+        std::vector<char> in;
+        size_t inPos = 0;
+        size_t sent = 0;
+        size_t received = 0;
+
+        result.latencies.reserve(opt.ops);
+
+        while (received < opt.ops)
+        {
+            //tops the pipeline up with one write
+            size_t upTo = (std::min)(opt.ops, received + opt.pipeline);
+            if (sent < upTo)
+            {
+                Clock::time_point now = Clock::now();
+                for (size_t i = sent; i < upTo; i++) sentAt[i] = now;
+
+                if (!writeAll(fd, requests.data() + offsets[sent], offsets[upTo] - offsets[sent])) break;
+                sent = upTo;
+            }
+
+            size_t at = in.size();
+            in.resize(at + 64 * 1024);
+
+            ssize_t n = read(fd, in.data() + at, 64 * 1024);
+            in.resize(at + (n > 0 ? (size_t)n : 0));
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+
+            Clock::time_point now = Clock::now();
+
+            while (in.size() - inPos >= sizeof(ds::IpcResponse))
+            {
+                ds::IpcResponse res;
+                std::memcpy(&res, in.data() + inPos, sizeof(res));
+
+                size_t size = sizeof(res) + res.count * sizeof(int64_t);
+                if (in.size() - inPos < size) break;
+                inPos += size;
+
+                if (res.id != received || res.status == ds::IPC_BAD_REQUEST) result.errors++;
+                if (res.status == ds::IPC_TRUE) result.hits++;
+                result.rangeKeys += res.count;
+
+                long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - sentAt[received]).count();
+                result.latencies.push_back((uint32_t)(std::min)(ns, (long long)UINT32_MAX));
+                received++;
+            }
+
+            if (inPos == in.size())
+            {
+                in.clear();
+                inPos = 0;
+            }
+        }
+
+        //whatever was never answered counts as failed
+        result.errors += opt.ops - received;
+    }
+
+    bool parse(int argc, char** argv, Options& opt)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) return false;
+            const char* value = argv[++i];
+
+            if (arg == "--socket") opt.socket = value;
+            else if (arg == "--connections") opt.connections = (std::max)((unsigned)std::strtoul(value, NULL, 10), 1u);
+            else if (arg == "--ops") opt.ops = (size_t)std::strtod(value, NULL);
+            else if (arg == "--pipeline") opt.pipeline = (std::max)((size_t)std::strtoull(value, NULL, 10), (size_t)1);
+            else if (arg == "--insert") opt.insertPercent = (unsigned)std::strtoul(value, NULL, 10);
+            else if (arg == "--delete") opt.deletePercent = (unsigned)std::strtoul(value, NULL, 10);
+            else if (arg == "--range") opt.rangePercent = (unsigned)std::strtoul(value, NULL, 10);
+            else if (arg == "--range-width") opt.rangeWidth = (int64_t)std::strtoll(value, NULL, 10);
+            else if (arg == "--pattern") { if (!ds::Workload::parsePattern(value, opt.pattern)) return false; }
+            else if (arg == "--key-space") opt.keySpace = (int64_t)std::strtod(value, NULL);
+            else if (arg == "--seed") opt.seed = std::strtoull(value, NULL, 10);
+            else return false;
+        }
+
+        //ids are 32 bits and must match the request index
+        return opt.ops <= UINT32_MAX && opt.insertPercent + opt.deletePercent <= 100 && opt.rangePercent <= 100;
+    }
+
+    uint32_t quantile(const std::vector<uint32_t>& sorted, double q)
+    {
+        if (sorted.empty()) return 0;
+        return sorted[(std::min)((size_t)(q * (double)sorted.size()), sorted.size() - 1)];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    if (!parse(argc, argv, opt))
+    {
+        std::fprintf(stderr, "usage: LoadGen [--socket path] [--connections n] [--ops n] [--pipeline n] [--insert pct] [--delete pct]\n"
+            "               [--range pct] [--range-width n] [--pattern name] [--key-space n] [--seed n]\n");
+        return 1;
+    }
+
+    std::vector<int> fds(opt.connections, -1);
+    std::vector<std::vector<char>> requests(opt.connections);
+    std::vector<std::vector<size_t>> offsets(opt.connections);
+    std::vector<ConnectionResult> results(opt.connections);
+
+    for (unsigned i = 0; i < opt.connections; i++)
+    {
+        fds[i] = connectTo(opt.socket);
+        if (fds[i] < 0)
+        {
+            std::fprintf(stderr, "cannot connect to %s: %s\n", opt.socket.c_str(), std::strerror(errno));
+            for (int fd : fds) if (fd >= 0) close(fd);
+            return 1;
+        }
+
+        requests[i] = encode(opt, i, offsets[i]);
+    }
+
+    Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < opt.connections; i++)
+        threads.emplace_back([&, i] { drive(opt, fds[i], requests[i], offsets[i], results[i]); });
+    for (auto& t : threads) t.join();
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint32_t> latencies;
+    uint64_t errors = 0, hits = 0, rangeKeys = 0;
+
+    for (unsigned i = 0; i < opt.connections; i++)
+    {
+        close(fds[i]);
+        latencies.insert(latencies.end(), results[i].latencies.begin(), results[i].latencies.end());
+        errors += results[i].errors;
+        hits += results[i].hits;
+        rangeKeys += results[i].rangeKeys;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("%u connections, pipeline %zu, pattern %s\n", opt.connections, opt.pipeline, ds::Workload::patternName(opt.pattern));
+    std::printf("%zu ops in %.3f ms, %.0f ops/s, %llu hits, %llu range keys, %llu errors\n", latencies.size(), seconds * 1000,
+        (seconds > 0) ? latencies.size() / seconds : 0.0, (unsigned long long)hits, (unsigned long long)rangeKeys, (unsigned long long)errors);
+    std::printf("latency p50 %u ns, p99 %u ns, p99.9 %u ns, max %u ns\n", quantile(latencies, 0.5), quantile(latencies, 0.99),
+        quantile(latencies, 0.999), latencies.empty() ? 0u : latencies.back());
+
+    return (errors > 0) ? 2 : 0;
+}
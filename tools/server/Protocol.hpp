@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//wire format between Server and its clients over a Unix domain socket. both ends are on the same host, so
+//every field is in native byte order. requests may be pipelined: a client can send any number before
+//reading, the responses come back in request order on the same connection
+namespace ds
+{
+    enum IpcOp : uint8_t
+    {
+        IPC_INSERT = 0,
+        IPC_REMOVE,
+        IPC_SEARCH,
+        IPC_RANGE                               //followed by the int64_t upper bound
+    };
+
+    enum IpcStatus : uint8_t
+    {
+        IPC_FALSE = 0,                          //key was present, not removed or not found
+        IPC_TRUE,
+        IPC_TRUNCATED,                          //range answered with its first IPC_MAX_RANGE keys only
+        IPC_BAD_REQUEST                         //unknown op, the server closes the connection after answering
+    };
+
+    struct IpcRequest
+    {
+        uint32_t id;                            //echoed in the response
+        uint8_t op;
+        uint8_t reserved[3];
+        int64_t key;                            //lower bound for IPC_RANGE
+    };
+
+    struct IpcResponse
+    {
+        uint32_t id;
+        uint8_t status;
+        uint8_t reserved[3];
+        uint32_t count;                         //int64_t keys following, IPC_RANGE only
+    };
+
+    const size_t IPC_MAX_RANGE = 65536;
+
+    //bytes of the request starting at p, 0 if op is unknown
+    inline size_t ipcRequestSize(const char* p)
+    {
+        uint8_t op = (uint8_t)p[offsetof(IpcRequest, op)];
+        if (op > IPC_RANGE) return 0;
+
+        return sizeof(IpcRequest) + ((op == IPC_RANGE) ? sizeof(int64_t) : 0);
+    }
+}
@@ -0,0 +1,540 @@
+//serves one ds::TwoThreeTree<int64_t> to the processes of a host over a Unix domain socket, Linux only.
+//one thread runs an epoll loop that owns every socket: it reads requests, hands each connection's complete
+//requests to the worker pool as one batch and writes the responses back. workers run searches and ranges
+//under a shared lock, so reads proceed in parallel, and inserts and deletes under the exclusive lock.
+//a connection has at most one batch in flight, which keeps its responses in request order
+//
+//  Server [--socket path] [--threads n] [--preload n] [--key-space n] [--seed n]
+//  g++ -std=c++17 -O2 -pthread -I../../src Server.cpp -o Server
+
+#ifndef __linux__
+#error "the IPC server is built on epoll and Unix domain sockets and only builds on Linux"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "TwoThreeTree.hpp"
+#include "Workload.hpp"
+#include "Protocol.hpp"
+
+namespace
+{
+    const size_t READ_SIZE = 64 * 1024;
+    const size_t IN_LIMIT = 4 << 20;            //unprocessed bytes a connection may queue before reads pause
+    const size_t OUT_LIMIT = 4 << 20;           //unsent response bytes past which a connection gets no more work
+
+    struct Options
+    {
+        std::string socket{ "/tmp/twothreetree.sock" };
+        unsigned threads{ (std::max)(std::thread::hardware_concurrency(), 1u) };
+        size_t preload{ 0 };
+        int64_t keySpace{ 1 << 24 };
+        uint64_t seed{ 1 };
+    };
+
+    struct Connection
+    {
+        int fd;
+        std::vector<char> in;                   //received bytes not yet handed to a worker
+        std::vector<char> batch;                //complete requests owned by the worker while busy
+        size_t consumed{ 0 };                   //bytes of batch the worker answered, the rest goes back to in
+        std::vector<char> reply;                //responses to batch, written by the worker
+        std::vector<char> out;                  //responses waiting for the socket
+        size_t outPos{ 0 };
+        bool busy{ false };
+        bool closing{ false };                  //peer hung up or sent a bad request
+        bool dropped{ false };                  //peer stopped reading, whatever is queued for it is discarded
+        uint32_t events{ 0 };                   //what epoll currently watches
+        bool watched{ true };                   //registered with epoll at all, hang-ups are reported regardless of events
+    };
+
+    std::atomic<bool> stopping{ false };
+    int wakeFd = -1;                            //eventfd the workers and the signal handler wake the loop with
+
+    void onSignal(int)
+    {
+        stopping = true;
+        uint64_t one = 1;
+        ssize_t r = write(wakeFd, &one, sizeof(one));
+        (void)r;
+    }
+
+    class Server
+    {
+    public:
+        explicit Server(const Options& opt) : opt(opt) {}
+
+        bool start()
+        {
+            if (opt.preload > 0)
+            {
+                ds::WorkloadConfig config;
+                config.keySpace = opt.keySpace;
+                config.seed = opt.seed;
+
+                ds::Workload workload(config);
+                std::vector<int64_t> keys = workload.preload(opt.preload);
+                tree.buildParallel(keys.begin(), keys.end());
+            }
+
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenFd < 0) return fail("socket");
+
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (opt.socket.size() >= sizeof(addr.sun_path))
+            {
+                std::fprintf(stderr, "socket path too long\n");
+                return false;
+            }
+
+            std::memcpy(addr.sun_path, opt.socket.c_str(), opt.socket.size() + 1);
+            unlink(opt.socket.c_str());
+
+            if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) return fail("bind");
+            if (listen(listenFd, 128) != 0) return fail("listen");
+
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+            wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epollFd < 0 || wakeFd < 0) return fail("epoll");
+
+            watchFd(listenFd, EPOLLIN);
+            watchFd(wakeFd, EPOLLIN);
+
+            for (unsigned i = 0; i < opt.threads; i++) workers.emplace_back([this] { work(); });
+            return true;
+        }
+
+        void run()
+        {
+            epoll_event events[256];
+
+            while (!stopping)
+            {
+                int n = epoll_wait(epollFd, events, 256, -1);
+                if (n < 0 && errno != EINTR) break;
+
+                for (int i = 0; i < n; i++)
+                {
+                    int fd = events[i].data.fd;
+
+                    if (fd == listenFd) acceptAll();
+                    else if (fd == wakeFd) collectReplies();
+                    else
+                    {
+                        auto it = connections.find(fd);
+                        if (it == connections.end()) continue;
+
+                        //what the peer sent before hanging up is still read and answered
+                        Connection* c = it->second.get();
+                        if (events[i].events & (EPOLLIN | EPOLLHUP)) readFrom(c);
+                        if (events[i].events & EPOLLERR) c->closing = true;
+                        if (events[i].events & EPOLLOUT) writeTo(c);
+                        settle(c);
+                    }
+                }
+            }
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                quitting = true;
+            }
+
+            queueReady.notify_all();
+            for (auto& w : workers) w.join();
+
+            for (auto& c : connections) close(c.first);
+            connections.clear();
+
+            if (listenFd >= 0) close(listenFd);
+            if (epollFd >= 0) close(epollFd);
+            if (wakeFd >= 0) close(wakeFd);
+            unlink(opt.socket.c_str());
+
+            std::fprintf(stderr, "served %llu requests on %llu connections\n", (unsigned long long)served.load(), (unsigned long long)accepted);
+        }
+
+    private:
+        bool fail(const char* what)
+        {
+            std::fprintf(stderr, "%s: %s\n", what, std::strerror(errno));
+            return false;
+        }
+
+        void watchFd(int fd, uint32_t events)
+        {
+            epoll_event e{};
+            e.events = events;
+            e.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &e);
+        }
+
+        void acceptAll()
+        {
+            for (;;)
+            {
+                int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) return;
+
+                std::unique_ptr<Connection> c(new Connection());
+                c->fd = fd;
+                c->events = EPOLLIN;
+                watchFd(fd, EPOLLIN);
+
+                connections[fd] = std::move(c);
+                accepted++;
+            }
+        }
+
+        void readFrom(Connection* c)
+        {
+            while (!c->closing && c->in.size() < IN_LIMIT)
+            {
+                size_t at = c->in.size();
+                c->in.resize(at + READ_SIZE);
+
+                ssize_t n = read(c->fd, c->in.data() + at, READ_SIZE);
+                c->in.resize(at + (n > 0 ? (size_t)n : 0));
+
+                if (n > 0) continue;
+                if (n == 0 || (errno != EAGAIN && errno != EINTR)) c->closing = true;
+                if (n < 0 && errno == EINTR) continue;
+                break;
+            }
+        }
+
+        void writeTo(Connection* c)
+        {
+            while (c->outPos < c->out.size())
+            {
+                ssize_t n = write(c->fd, c->out.data() + c->outPos, c->out.size() - c->outPos);
+
+                if (n > 0) c->outPos += (size_t)n;
+                else if (n < 0 && errno == EINTR) continue;
+                else if (n < 0 && errno == EAGAIN) break;
+                else
+                {
+                    //the peer is gone, nobody is left to read the rest or the answers to what is still queued
+                    c->closing = true;
+                    c->dropped = true;
+                    c->outPos = c->out.size();
+                    c->in.clear();
+                }
+            }
+
+            if (c->outPos == c->out.size())
+            {
+                c->out.clear();
+                c->outPos = 0;
+            }
+        }
+
+        //dispatches what can be, then closes the connection or updates what epoll watches for it. a client that
+        //sends without reading gets no more work, and is not read from, until its responses drain below OUT_LIMIT
+        void settle(Connection* c)
+        {
+            bool backlogged = c->out.size() - c->outPos >= OUT_LIMIT;
+            if (!backlogged) dispatch(c);
+
+            if (c->closing && !c->busy && c->out.empty())
+            {
+                int fd = c->fd;
+                close(fd);
+                connections.erase(fd);
+                return;
+            }
+
+            uint32_t events = 0;
+            if (!c->closing && !backlogged && c->in.size() < IN_LIMIT) events |= EPOLLIN;
+            if (!c->out.empty()) events |= EPOLLOUT;
+
+            //a hung up connection waiting for its batch leaves epoll, or its hang-up would be reported again
+            //and again until the batch is done
+            epoll_event e{};
+            e.events = events;
+            e.data.fd = c->fd;
+
+            if (events == 0 && c->closing)
+            {
+                if (c->watched) epoll_ctl(epollFd, EPOLL_CTL_DEL, c->fd, &e);
+                c->watched = false;
+            }
+            else if (!c->watched)
+            {
+                epoll_ctl(epollFd, EPOLL_CTL_ADD, c->fd, &e);
+                c->watched = true;
+            }
+            else if (events != c->events) epoll_ctl(epollFd, EPOLL_CTL_MOD, c->fd, &e);
+
+            c->events = events;
+        }
+
+        //hands the complete requests at the front of in to a worker
+        void dispatch(Connection* c)
+        {
+            if (c->busy || c->in.empty()) return;
+
+            size_t end = 0;
+
+            while (c->in.size() - end >= sizeof(ds::IpcRequest))
+            {
+                size_t size = ds::ipcRequestSize(c->in.data() + end);
+
+                if (size == 0)
+                {
+                    //answered in order by the worker, everything after it is dropped
+                    end += sizeof(ds::IpcRequest);
+                    c->closing = true;
+                    break;
+                }
+
+                if (c->in.size() - end < size) break;
+                end += size;
+            }
+
+            if (end == 0) return;
+
+            c->batch.assign(c->in.begin(), c->in.begin() + end);
+            c->in.erase(c->in.begin(), c->closing ? c->in.end() : c->in.begin() + end);
+            c->busy = true;
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                queue.push_back(c);
+            }
+
+            queueReady.notify_one();
+        }
+
+        void collectReplies()
+        {
+            uint64_t count;
+            ssize_t r = read(wakeFd, &count, sizeof(count));
+            (void)r;
+
+            std::vector<Connection*> ready;
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                ready.swap(done);
+            }
+
+            for (Connection* c : ready)
+            {
+                c->busy = false;
+                c->out.insert(c->out.end(), c->reply.begin(), c->reply.end());
+                c->reply.clear();
+
+                //requests the worker stopped before are the oldest ones still unanswered
+                if (c->consumed < c->batch.size() && !c->dropped) c->in.insert(c->in.begin(), c->batch.begin() + c->consumed, c->batch.end());
+
+                writeTo(c);
+                settle(c);
+            }
+        }
+
+        void work()
+        {
+            for (;;)
+            {
+                Connection* c;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueReady.wait(lock, [this] { return quitting || !queue.empty(); });
+                    if (quitting) return;
+
+                    c = queue.front();
+                    queue.pop_front();
+                }
+
+                execute(c);
+
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    done.push_back(c);
+                }
+
+                uint64_t one = 1;
+                ssize_t r = write(wakeFd, &one, sizeof(one));
+                (void)r;
+            }
+        }
+
+        //runs a batch in order, stopping early once the responses reach OUT_LIMIT since a few range requests can
+        //answer with far more bytes than they take. the lock is only switched between shared and exclusive where
+        //the kind of request changes, so a run of searches costs one acquisition
+        void execute(Connection* c)
+        {
+            std::shared_lock<std::shared_mutex> readLock(treeMutex, std::defer_lock);
+            std::unique_lock<std::shared_mutex> writeLock(treeMutex, std::defer_lock);
+            std::vector<int64_t> keys;
+
+            const char* p = c->batch.data();
+            const char* end = p + c->batch.size();
+            uint64_t count = 0;
+
+            while (p < end && c->reply.size() < OUT_LIMIT)
+            {
+                ds::IpcRequest req;
+                std::memcpy(&req, p, sizeof(req));
+
+                ds::IpcResponse res{};
+                res.id = req.id;
+
+                size_t size = ds::ipcRequestSize(p);
+                if (size == 0)
+                {
+                    res.status = ds::IPC_BAD_REQUEST;
+                    appendReply(c, res, keys);
+                    p = end;
+                    break;
+                }
+
+                bool mutates = req.op == ds::IPC_INSERT || req.op == ds::IPC_REMOVE;
+
+                if (mutates && !writeLock.owns_lock())
+                {
+                    if (readLock.owns_lock()) readLock.unlock();
+                    writeLock.lock();
+                }
+                else if (!mutates && !readLock.owns_lock())
+                {
+                    if (writeLock.owns_lock()) writeLock.unlock();
+                    readLock.lock();
+                }
+
+                keys.clear();
+
+                switch (req.op)
+                {
+                case ds::IPC_INSERT: res.status = tree.insert(req.key) ? ds::IPC_TRUE : ds::IPC_FALSE; break;
+                case ds::IPC_REMOVE: res.status = tree.deleteNode(req.key) ? ds::IPC_TRUE : ds::IPC_FALSE; break;
+                case ds::IPC_SEARCH: res.status = (tree.searchFor(req.key) != NULL) ? ds::IPC_TRUE : ds::IPC_FALSE; break;
+
+                default:
+                {
+                    int64_t hi;
+                    std::memcpy(&hi, p + sizeof(req), sizeof(hi));
+
+                    bool truncated = false;
+                    tree.forRange(req.key, hi, [&](int64_t k)
+                        {
+                            if (keys.size() < ds::IPC_MAX_RANGE) keys.push_back(k);
+                            else truncated = true;
+                        });
+
+                    res.status = truncated ? ds::IPC_TRUNCATED : ds::IPC_TRUE;
+                    res.count = (uint32_t)keys.size();
+                    break;
+                }
+                }
+
+                appendReply(c, res, keys);
+                p += size;
+                count++;
+            }
+
+            c->consumed = (size_t)(p - c->batch.data());
+            served += count;
+        }
+
+        static void appendReply(Connection* c, const ds::IpcResponse& res, const std::vector<int64_t>& keys)
+        {
+            size_t at = c->reply.size();
+            c->reply.resize(at + sizeof(res) + res.count * sizeof(int64_t));
+
+            std::memcpy(c->reply.data() + at, &res, sizeof(res));
+            if (res.count > 0) std::memcpy(c->reply.data() + at + sizeof(res), keys.data(), res.count * sizeof(int64_t));
+        }
+
+    private:
+        Options opt;
+
+        //searchFor and forRange only read the tree while the lookup cache, Bloom filter and write buffers are
+        //off and no counters are kept, which is what makes the shared lock enough for them
+        ds::TwoThreeTree<int64_t> tree;
+        std::shared_mutex treeMutex;
+
+        int listenFd{ -1 };
+        int epollFd{ -1 };
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        uint64_t accepted{ 0 };
+        std::atomic<uint64_t> served{ 0 };
+
+        std::vector<std::thread> workers;
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::deque<Connection*> queue;
+        bool quitting{ false };
+
+        std::mutex doneMutex;
+        std::vector<Connection*> done;
+    };
+
+    bool parse(int argc, char** argv, Options& opt)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) return false;
+            const char* value = argv[++i];
+
+            if (arg == "--socket") opt.socket = value;
+            else if (arg == "--threads") opt.threads = (std::max)((unsigned)std::strtoul(value, NULL, 10), 1u);
+            else if (arg == "--preload") opt.preload = (size_t)std::strtod(value, NULL);
+            else if (arg == "--key-space") opt.keySpace = (int64_t)std::strtod(value, NULL);
+            else if (arg == "--seed") opt.seed = std::strtoull(value, NULL, 10);
+            else return false;
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    if (!parse(argc, argv, opt))
+    {
+        std::fprintf(stderr, "usage: Server [--socket path] [--threads n] [--preload n] [--key-space n] [--seed n]\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server(opt);
+    if (!server.start()) return 1;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    std::fprintf(stderr, "serving on %s with %u workers\n", opt.socket.c_str(), opt.threads);
+    server.run();
+    server.stop();
+    return 0;
+}